@@ -2,6 +2,7 @@
 
 @set BUILD_DIR=build
 @set BIN_NAME=sabrewing.exe
+@set BIN_NAME_CLI=sabrewing-cli.exe
 
 @set SRC_DIR=..\src
 @set EXT_DIR=..\ext
@@ -17,6 +18,7 @@
 @set SOURCES_IMGUI=%IMGUI_DIR%\imgui*.cpp %IMGUI_DIR%\backends\imgui_impl_sdl2.cpp %IMGUI_DIR%\backends\imgui_impl_opengl3.cpp
 @set SOURCES_IMPLOT=%IMPLOT_DIR%\*.cpp
 @set SOURCES_PROJ=%SRC_DIR%\gui.cpp
+@set SOURCES_CLI=%SRC_DIR%\cli.c
 
 @set LIBS=/LIBPATH:%SDL2_DIR%\lib\x64 SDL2.lib SDL2main.lib opengl32.lib shell32.lib
 
@@ -41,6 +43,11 @@ rc /nologo /fo..\%BUILD_DIR%\resources.res ../res/resources.rc
 :: Link
 cl /nologo *.obj resources.res /Zi /link %LIBS% /SUBSYSTEM:WINDOWS /ENTRY:mainCRTStartup /OUT:%BIN_NAME% || goto :error
 
+:: Compile and link the headless CLI (plain C; no SDL). Its object file goes into a separate
+:: directory so that it doesn't get linked into the GUI above.
+if not exist cli mkdir cli
+cl /nologo /W4 /Zi /FC /utf-8 /MT %OPTIMIZER_FLAGS% %DEFINES% /Focli\ /Fdcli\ %SOURCES_CLI% /link /SUBSYSTEM:CONSOLE /OUT:%BIN_NAME_CLI% || goto :error
+
 :: Copy DLLs to build directory
 echo Copying DLLs...
 copy %SDL2_DIR%\lib\x64\SDL2.dll . /b
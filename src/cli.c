@@ -0,0 +1,747 @@
+// Headless command-line front-end for the profiler. Unlike the GUI, this needs neither SDL nor
+// OpenGL: it runs a single profiler run on the main thread and writes the results as CSV.
+//
+// Like the GUI, everything is compiled as a single translation unit. See testc.c for why.
+//
+// Example:
+//
+//     $ ./sabrewing-cli --target "Merge sort" --n 0:10:1000 --sample-size 20 > merge.csv
+
+
+#include "util.c"
+#include "util_thread.c"
+#include "logger.c"
+#include "cpuinfo.c"
+#include "perfcounter.c"
+#include "problems/sort.c"  // Choose one problem here (compiled in, for now).
+#include "profiler.c"
+#include "complexity.c"
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+
+/**** Constants ****/
+
+// How long to wait between the two calls to query_host_info(), so that the TSC frequency can be
+// estimated before the profiler starts.
+#define CLI_TSC_CALIBRATION_MS 200
+
+#define CLI_EXIT_SUCCESS 0
+#define CLI_EXIT_FAILURE 1              // Bad arguments, or a system error.
+#define CLI_EXIT_VERIFICATION_FAILURE 2  // The run completed, but the verifier rejected some units.
+#define CLI_EXIT_COMPLEXITY_FAILURE 3    // The run grew faster than --expect-complexity allows.
+
+
+/**** Types ****/
+
+typedef struct
+{
+    ProfilerParams params;
+    char const* groups_path;  // NULL means stdout.
+    char const* units_path;   // NULL means don't write per-unit data.
+    bool quiet;
+    bool expect_complexity;
+    ComplexityModelID expected_complexity;
+} CliOptions;
+
+
+/**** Functions ****/
+
+void cli_print_usage(FILE* f)
+{
+    char percentiles_default[128];
+    profiler_params_format_percentiles(
+            profiler_params_default(), percentiles_default, sizeof(percentiles_default));
+    fprintf(f,
+            "Usage: sabrewing-cli [options]\n"
+            "\n"
+            "Problem: %s\n"
+            "\n"
+            "Options:\n"
+            "  --sampler NAME|INDEX      Input distribution (see --list).\n"
+            "  --target NAME|INDEX       Algorithm to profile (see --list).\n"
+            "  --verifier NAME|INDEX     Verifier for target output (see --list).\n"
+            "  --no-verify               Don't verify the target's output.\n"
+            "  --n MIN:STRIDE:MAX        Range for n.\n"
+            "  --n-geometric MIN:PER_DECADE:MAX\n"
+            "                            Geometric range for n: PER_DECADE values for every factor\n"
+            "                            of 10, rounded to integers (instead of --n).\n"
+            "  --n-caches K              Take K values of n around each data cache size of this\n"
+            "                            CPU, from half to twice its size; at most %u (instead\n"
+            "                            of --n).\n"
+            "  --refine N                After the range, measure up to N more values of n where\n"
+            "                            the curve of the medians bends most sharply.\n"
+            "  --sample-size K           Number of inputs for each n (the most, if adaptive).\n"
+            "  --precision PCT           Adaptive sampling: stop taking inputs for each n once the\n"
+            "                            95%% confidence interval of the mean is within PCT\n"
+            "                            percent of it (0: off).\n"
+            "  --min-sample-size K       Adaptive sampling: the fewest inputs for each n\n"
+            "                            (default: %u).\n"
+            "  --precision-of-median     Adaptive sampling: converge on the median, not the mean.\n"
+            "  --percentiles LIST        Percentiles to report for each n, besides the median, in\n"
+            "                            increasing order; at most %u (default: %s).\n"
+            "  --seed SEED               RNG seed (default: 0).\n"
+            "  --seed-from-time          Seed the RNG with the current time.\n"
+            "  --timing NAME             Timing method, or hardware counter (see --list).\n"
+            "  --repetitions R           Repeat the run, keeping the minimum time for each unit.\n"
+            "  --stable-repetitions S    Skip a unit in later repetitions once S repetitions in a\n"
+            "                            row haven't lowered its minimum (0: never skip).\n"
+            "  --warmup MS               Busy-wait before the run to reach boost frequency.\n"
+            "  --adjust-for-overhead     Subtract the measured timer overhead.\n"
+            "  --reject-disturbed        Re-measure units hit by a context switch or page fault.\n"
+            "  --huge-pages KIND         Back the input, output and scratch buffers with huge pages:\n"
+            "                            off, transparent, or explicit (default: off).\n"
+            "  --lock-memory             Lock the run's memory into RAM (it's always pre-faulted).\n"
+            "  --track-memory            Record the peak scratch and stack usage for each unit.\n"
+            "  --numa PLACEMENT          Put the run's memory on the NUMA node that's any (the\n"
+            "                            kernel's choice), local, or remote (default: any).\n"
+            "  --cache STATE             Where the input is in the cache hierarchy when the target\n"
+            "                            is called: hot, llc, or cold (default: hot).\n"
+            "  --unit-timeout MS         Stop increasing n once a unit takes longer than this\n"
+            "                            (0: no limit; default: %u).\n"
+            "  --run-budget S            Stop the run once it has taken longer than this\n"
+            "                            (0: no limit; default: %u).\n"
+            "  --batch US                Time calls in batches lasting at least US microseconds,\n"
+            "                            for very fast targets (0: no batching).\n"
+            "  --expect-complexity MODEL Fail if the median time grows faster than MODEL: one of\n"
+            "                            1, logn, n, nlogn, n2, n3.\n"
+            "  --output PATH             Write per-n summary (CSV) to PATH instead of stdout.\n"
+            "  --units PATH              Also write every unit's measurement (CSV) to PATH.\n"
+            "  --quiet                   Don't print progress information to stderr.\n"
+            "  --list                    List available samplers, targets, verifiers, timers.\n"
+            "  --help                    Show this message.\n"
+            "\n"
+            "Exit status: %d on success, %d on error, %d if the verifier rejected any unit,\n"
+            "%d if the expected complexity was exceeded.\n",
+            problem_description(),
+            PROFILER_CACHE_SWEEP_PER_CACHE_MAX,
+            profiler_params_default().sample_size_min,
+            PROFILER_PERCENTILES_MAX,
+            percentiles_default,
+            profiler_params_default().unit_timeout_ms,
+            profiler_params_default().run_budget_s,
+            CLI_EXIT_SUCCESS, CLI_EXIT_FAILURE, CLI_EXIT_VERIFICATION_FAILURE,
+            CLI_EXIT_COMPLEXITY_FAILURE);
+}
+
+void cli_print_list(FILE* f, HostInfo* host)
+{
+    fprintf(f, "Samplers:\n");
+    for (u32 i = 0; i < (u32)ARRAY_SIZE(samplers); ++i) {
+        fprintf(f, "  %2u  %-24s %s\n", i, samplers[i].name, samplers[i].description);
+    }
+    fprintf(f, "Targets:\n");
+    for (u32 i = 0; i < (u32)ARRAY_SIZE(targets); ++i) {
+        fprintf(f, "  %2u  %-24s %s\n", i, targets[i].name, targets[i].description);
+    }
+    fprintf(f, "Verifiers:\n");
+    for (u32 i = 0; i < (u32)ARRAY_SIZE(verifiers); ++i) {
+        fprintf(f, "  %2u  %-24s %s\n", i, verifiers[i].name, verifiers[i].description);
+    }
+    fprintf(f, "Timing methods:\n");
+    for (u32 i = 0; i < TIMING_METHOD_ID_MAX; ++i) {
+        if (timing_method_available((TimingMethodID)i, host)) {
+            fprintf(f, "      %-24s %s\n", timing_methods[i].name_short, timing_methods[i].name_long);
+        }
+    }
+}
+
+// Case-insensitive (ASCII) string comparison.
+bool cli_names_equal(char const* a, char const* b)
+{
+    for (; *a && *b; ++a, ++b) {
+        char ca = (*a >= 'A' && *a <= 'Z') ? (char)(*a - 'A' + 'a') : *a;
+        char cb = (*b >= 'A' && *b <= 'Z') ? (char)(*b - 'A' + 'a') : *b;
+        if (ca != cb) {
+            return false;
+        }
+    }
+    return *a == *b;
+}
+
+bool cli_parse_u64(char const* str, u64* out)
+{
+    if (!str || !*str) {
+        return false;
+    }
+    u64 value = 0;
+    for (char const* c = str; *c; ++c) {
+        if (*c < '0' || *c > '9') {
+            return false;
+        }
+        u64 digit = (u64)(*c - '0');
+        if (value > (U64_MAX - digit) / 10) {
+            return false;  // Overflow.
+        }
+        value = 10 * value + digit;
+    }
+    *out = value;
+    return true;
+}
+
+bool cli_parse_u32(char const* str, u32* out)
+{
+    u64 value = 0;
+    if (!cli_parse_u64(str, &value) || value > U32_MAX) {
+        return false;
+    }
+    *out = (u32)value;
+    return true;
+}
+
+// Parse a non-negative decimal number.
+bool cli_parse_f32(char const* str, f32* out)
+{
+    if (!str || !*str) {
+        return false;
+    }
+    char* end = NULL;
+    f64 value = strtod(str, &end);
+    if (*end != '\0' || !(value >= 0.0 && value <= 1.0e30)) {
+        return false;
+    }
+    *out = (f32)value;
+    return true;
+}
+
+// Parse a range of the form MIN:STRIDE:MAX, or a single value N (equivalent to N:1:N).
+bool cli_parse_range_u32(char const* str, range_u32* out)
+{
+    char buf[64] = {0};
+    if (strlen(str) >= sizeof(buf)) {
+        return false;
+    }
+    memcpy(buf, str, strlen(str));
+    char* fields[3] = {0};
+    u32 num_fields = 0;
+    fields[num_fields++] = buf;
+    for (char* c = buf; *c; ++c) {
+        if (*c == ':') {
+            if (num_fields == ARRAY_SIZE(fields)) {
+                return false;
+            }
+            *c = '\0';
+            fields[num_fields++] = c + 1;
+        }
+    }
+    range_u32 r = {0};
+    if (num_fields == 1) {
+        if (!cli_parse_u32(fields[0], &r.lower)) return false;
+        r.upper = r.lower;
+        r.stride = 1;
+    } else if (num_fields == 3) {
+        if (!cli_parse_u32(fields[0], &r.lower)) return false;
+        if (!cli_parse_u32(fields[1], &r.stride)) return false;
+        if (!cli_parse_u32(fields[2], &r.upper)) return false;
+    } else {
+        return false;
+    }
+    if (r.stride == 0 || r.lower > r.upper) {
+        return false;
+    }
+    *out = r;
+    return true;
+}
+
+// Parse a geometric range of the form MIN:PER_DECADE:MAX.
+bool cli_parse_range_geom_u32(char const* str, range_geom_u32* out)
+{
+    range_u32 r = {0};
+    if (!strchr(str, ':') || !cli_parse_range_u32(str, &r) || r.lower == 0) {
+        return false;
+    }
+    out->lower = r.lower;
+    out->per_decade = r.stride;
+    out->upper = r.upper;
+    return true;
+}
+
+// Look up an entry of a sampler/target/verifier array, either by index or by name.
+#define CLI_FIND_BY_NAME(_arr, _label, _str, _out)                      \
+    do {                                                                \
+        u32 _idx = 0;                                                   \
+        bool _found = false;                                            \
+        if (cli_parse_u32((_str), &_idx)) {                             \
+            _found = _idx < (u32)ARRAY_SIZE(_arr);                      \
+        } else {                                                        \
+            for (_idx = 0; _idx < (u32)ARRAY_SIZE(_arr); ++_idx) {      \
+                if (cli_names_equal((_arr)[_idx].name, (_str))) {       \
+                    _found = true;                                      \
+                    break;                                              \
+                }                                                       \
+            }                                                           \
+        }                                                               \
+        if (!_found) {                                                  \
+            fprintf(stderr, "Error: Unknown %s: %s\n", (_label), (_str)); \
+            return false;                                               \
+        }                                                               \
+        *(_out) = _idx;                                                 \
+    } while (0)
+
+bool cli_parse_timing(char const* str, HostInfo* host, TimingMethodID* out)
+{
+    for (u32 i = 0; i < TIMING_METHOD_ID_MAX; ++i) {
+        if (cli_names_equal(timing_methods[i].name_short, str)) {
+            if (!timing_method_available((TimingMethodID)i, host)) {
+                fprintf(stderr, "Error: Timing method %s is unavailable on this host.\n",
+                        timing_methods[i].name_short);
+                return false;
+            }
+            *out = (TimingMethodID)i;
+            return true;
+        }
+    }
+    fprintf(stderr, "Error: Unknown timing method: %s\n", str);
+    return false;
+}
+
+// Parse the name of a basic complexity model (the power law can't be expected).
+bool cli_parse_complexity(char const* str, ComplexityModelID* out)
+{
+    for (u32 i = 0; i <= COMPLEXITY_CUBIC; ++i) {
+        if (cli_names_equal(complexity_models[i].name_short, str)) {
+            *out = (ComplexityModelID)i;
+            return true;
+        }
+    }
+    fprintf(stderr, "Error: Unknown complexity model: %s\n", str);
+    return false;
+}
+
+bool cli_parse_huge_pages(char const* str, HugePagesID* out)
+{
+    for (u32 i = 0; i < HUGE_PAGES_ID_MAX; ++i) {
+        if (cli_names_equal(huge_pages_kinds[i].name_short, str)) {
+            *out = (HugePagesID)i;
+            return true;
+        }
+    }
+    fprintf(stderr, "Error: Unknown kind of huge pages: %s\n", str);
+    return false;
+}
+
+bool cli_parse_numa_placement(char const* str, NumaPlacementID* out)
+{
+    for (u32 i = 0; i < NUMA_PLACEMENT_ID_MAX; ++i) {
+        if (cli_names_equal(numa_placements[i].name_short, str)) {
+            *out = (NumaPlacementID)i;
+            return true;
+        }
+    }
+    fprintf(stderr, "Error: Unknown NUMA placement: %s\n", str);
+    return false;
+}
+
+bool cli_parse_cache_state(char const* str, CacheStateID* out)
+{
+    for (u32 i = 0; i < CACHE_STATE_ID_MAX; ++i) {
+        if (cli_names_equal(cache_states[i].name_short, str)) {
+            *out = (CacheStateID)i;
+            return true;
+        }
+    }
+    fprintf(stderr, "Error: Unknown cache state: %s\n", str);
+    return false;
+}
+
+// Parse the command line into `opts`. Return false (after printing a message) on error.
+// Sets *exit_early if the program should exit successfully without profiling (e.g., --help).
+bool cli_parse_args(i32 argc, char** argv, HostInfo* host, CliOptions* opts, bool* exit_early)
+{
+    *exit_early = false;
+    for (i32 i = 1; i < argc; ++i) {
+        char const* arg = argv[i];
+        char const* val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        // Flags without a value.
+        if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+            cli_print_usage(stdout);
+            *exit_early = true;
+            return true;
+        } else if (strcmp(arg, "--list") == 0) {
+            cli_print_list(stdout, host);
+            *exit_early = true;
+            return true;
+        } else if (strcmp(arg, "--no-verify") == 0) {
+            opts->params.verifier_enabled = false;
+            continue;
+        } else if (strcmp(arg, "--seed-from-time") == 0) {
+            opts->params.seed_from_time = true;
+            continue;
+        } else if (strcmp(arg, "--adjust-for-overhead") == 0) {
+            opts->params.adjust_for_timer_overhead = true;
+            continue;
+        } else if (strcmp(arg, "--precision-of-median") == 0) {
+            opts->params.precision_of_median = true;
+            continue;
+        } else if (strcmp(arg, "--lock-memory") == 0) {
+            opts->params.lock_memory = true;
+            continue;
+        } else if (strcmp(arg, "--track-memory") == 0) {
+            opts->params.track_memory = true;
+            continue;
+        } else if (strcmp(arg, "--reject-disturbed") == 0) {
+            opts->params.reject_disturbed = true;
+            continue;
+        } else if (strcmp(arg, "--quiet") == 0) {
+            opts->quiet = true;
+            continue;
+        }
+
+        // Options with a value.
+        if (!val) {
+            fprintf(stderr, "Error: Unknown option, or missing value: %s\n", arg);
+            return false;
+        }
+        ++i;
+        if (strcmp(arg, "--sampler") == 0) {
+            CLI_FIND_BY_NAME(samplers, "sampler", val, &opts->params.sampler_idx);
+        } else if (strcmp(arg, "--target") == 0) {
+            CLI_FIND_BY_NAME(targets, "target", val, &opts->params.target_idx);
+        } else if (strcmp(arg, "--verifier") == 0) {
+            CLI_FIND_BY_NAME(verifiers, "verifier", val, &opts->params.verifier_idx);
+            opts->params.verifier_enabled = true;
+        } else if (strcmp(arg, "--n") == 0) {
+            if (!cli_parse_range_u32(val, &opts->params.ns)) {
+                fprintf(stderr, "Error: Invalid range for n: %s\n", val);
+                return false;
+            }
+        } else if (strcmp(arg, "--n-caches") == 0) {
+            if (!cli_parse_u32(val, &opts->params.ns_caches.per_cache) ||
+                opts->params.ns_caches.per_cache == 0 ||
+                opts->params.ns_caches.per_cache > PROFILER_CACHE_SWEEP_PER_CACHE_MAX) {
+                fprintf(stderr, "Error: Invalid number of values for each cache: %s\n", val);
+                return false;
+            }
+            cache_sweep_from_host(&opts->params.ns_caches, host);
+            opts->params.ns_kind = RANGE_CACHES;
+        } else if (strcmp(arg, "--n-geometric") == 0) {
+            if (!cli_parse_range_geom_u32(val, &opts->params.ns_geom)) {
+                fprintf(stderr, "Error: Invalid geometric range for n: %s\n", val);
+                return false;
+            }
+            opts->params.ns_kind = RANGE_GEOMETRIC;
+        } else if (strcmp(arg, "--refine") == 0) {
+            if (!cli_parse_u32(val, &opts->params.refine_points)) {
+                fprintf(stderr, "Error: Invalid number of values for refinement: %s\n", val);
+                return false;
+            }
+        } else if (strcmp(arg, "--sample-size") == 0) {
+            if (!cli_parse_u32(val, &opts->params.sample_size) || opts->params.sample_size == 0) {
+                fprintf(stderr, "Error: Invalid sample size: %s\n", val);
+                return false;
+            }
+        } else if (strcmp(arg, "--precision") == 0) {
+            if (!cli_parse_f32(val, &opts->params.precision_pct) ||
+                opts->params.precision_pct > 100.0f) {
+                fprintf(stderr, "Error: Invalid precision: %s\n", val);
+                return false;
+            }
+        } else if (strcmp(arg, "--min-sample-size") == 0) {
+            if (!cli_parse_u32(val, &opts->params.sample_size_min) ||
+                opts->params.sample_size_min < 2) {
+                fprintf(stderr, "Error: Invalid minimum sample size: %s\n", val);
+                return false;
+            }
+        } else if (strcmp(arg, "--percentiles") == 0) {
+            if (!profiler_params_parse_percentiles(&opts->params, val)) {
+                fprintf(stderr, "Error: Invalid list of percentiles: %s\n", val);
+                return false;
+            }
+        } else if (strcmp(arg, "--seed") == 0) {
+            if (!cli_parse_u64(val, &opts->params.seed)) {
+                fprintf(stderr, "Error: Invalid seed: %s\n", val);
+                return false;
+            }
+        } else if (strcmp(arg, "--timing") == 0) {
+            if (!cli_parse_timing(val, host, &opts->params.timing)) {
+                return false;
+            }
+        } else if (strcmp(arg, "--repetitions") == 0) {
+            if (!cli_parse_u32(val, &opts->params.repetitions) || opts->params.repetitions == 0) {
+                fprintf(stderr, "Error: Invalid number of repetitions: %s\n", val);
+                return false;
+            }
+        } else if (strcmp(arg, "--stable-repetitions") == 0) {
+            if (!cli_parse_u32(val, &opts->params.stable_repetitions)) {
+                fprintf(stderr, "Error: Invalid number of stable repetitions: %s\n", val);
+                return false;
+            }
+        } else if (strcmp(arg, "--warmup") == 0) {
+            if (!cli_parse_u32(val, &opts->params.warmup_ms)) {
+                fprintf(stderr, "Error: Invalid warmup time: %s\n", val);
+                return false;
+            }
+        } else if (strcmp(arg, "--unit-timeout") == 0) {
+            if (!cli_parse_u32(val, &opts->params.unit_timeout_ms)) {
+                fprintf(stderr, "Error: Invalid unit timeout: %s\n", val);
+                return false;
+            }
+        } else if (strcmp(arg, "--run-budget") == 0) {
+            if (!cli_parse_u32(val, &opts->params.run_budget_s)) {
+                fprintf(stderr, "Error: Invalid run budget: %s\n", val);
+                return false;
+            }
+        } else if (strcmp(arg, "--batch") == 0) {
+            if (!cli_parse_u32(val, &opts->params.batch_target_us)) {
+                fprintf(stderr, "Error: Invalid batch duration: %s\n", val);
+                return false;
+            }
+        } else if (strcmp(arg, "--huge-pages") == 0) {
+            if (!cli_parse_huge_pages(val, &opts->params.huge_pages)) {
+                return false;
+            }
+        } else if (strcmp(arg, "--numa") == 0) {
+            if (!cli_parse_numa_placement(val, &opts->params.numa_placement)) {
+                return false;
+            }
+        } else if (strcmp(arg, "--cache") == 0) {
+            if (!cli_parse_cache_state(val, &opts->params.cache_state)) {
+                return false;
+            }
+        } else if (strcmp(arg, "--expect-complexity") == 0) {
+            if (!cli_parse_complexity(val, &opts->expected_complexity)) {
+                return false;
+            }
+            opts->expect_complexity = true;
+        } else if (strcmp(arg, "--output") == 0) {
+            opts->groups_path = val;
+        } else if (strcmp(arg, "--units") == 0) {
+            opts->units_path = val;
+        } else {
+            fprintf(stderr, "Error: Unknown option: %s\n", arg);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Write the summary of each group that was measured (all of them, unless the run timed out).
+bool cli_write_groups(char const* path, ProfilerParams params, ProfilerResult result)
+{
+    FILE* f = path ? fopen(path, "w") : stdout;
+    if (!f) {
+        fprintf(stderr, "Error: Failed to open %s for writing.\n", path);
+        return false;
+    }
+    char const* metric = timing_methods[params.timing].metric_name;
+    bool batching = params.batch_target_us != 0;
+    fprintf(f, "n,%s_min,%s_max,%s_mean,%s_median,%s_stddev,%s_ci95",
+            metric, metric, metric, metric, metric, metric);
+    for (u32 p = 0; p < params.percentiles_count; ++p) {
+        fprintf(f, ",%s_p%g", metric, params.percentiles[p]);
+    }
+    fprintf(f, "%s%s\n",
+            batching ? ",batch_size" : "",
+            params.track_memory ? ",scratch_peak,stack_peak" : "");
+    for (u32 i = 0; i < *result.groups_valid; ++i) {
+        ProfilerResultGroup* g = &result.groups[i];
+        fprintf(f, "%.0f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f",
+                g->n, g->time_min, g->time_max, g->time_mean, g->time_median,
+                g->time_stddev, g->time_ci95);
+        for (u32 p = 0; p < params.percentiles_count; ++p) {
+            fprintf(f, ",%.3f", g->time_percentiles[p]);
+        }
+        if (batching) {
+            fprintf(f, ",%u", g->batch_size);
+        }
+        if (params.track_memory) {
+            fprintf(f, ",%.0f,%.0f", g->scratch_peak, g->stack_peak);
+        }
+        fprintf(f, "\n");
+    }
+    bool success = !ferror(f);
+    if (path) {
+        success = (fclose(f) == 0) && success;
+    } else {
+        fflush(f);
+    }
+    return success;
+}
+
+bool cli_write_units(char const* path, ProfilerParams params, ProfilerResult result)
+{
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Error: Failed to open %s for writing.\n", path);
+        return false;
+    }
+    fprintf(f, "n,%s%s%s\n", timing_methods[params.timing].metric_name,
+            params.reject_disturbed ? ",context_switches,page_faults" : "",
+            params.track_memory ? ",scratch_peak,stack_peak" : "");
+    for (u32 i = 0; i < *result.units_published; ++i) {
+        ProfilerResultUnits u = result.units;  // For brevity.
+        fprintf(f, "%.0f,%.3f", u.n[i], u.time[i]);
+        if (params.reject_disturbed) {
+            fprintf(f, ",%u,%u", u.context_switches[i], u.page_faults[i]);
+        }
+        if (params.track_memory) {
+            fprintf(f, ",%" PRIu64 ",%u", u.scratch_peak[i], u.stack_peak[i]);
+        }
+        fprintf(f, "\n");
+    }
+    bool success = !ferror(f);
+    success = (fclose(f) == 0) && success;
+    return success;
+}
+
+int main(int argc, char** argv)
+{
+    HostInfo host = {0};
+    query_host_info(&host);
+
+    CliOptions opts = {0};
+    opts.params = profiler_params_default();
+    // There is no GUI thread to keep responsive, so run the profiler on the main thread.
+    opts.params.separate_thread = false;
+    if (!timing_method_available(opts.params.timing, &host)) {
+        opts.params.timing = TIMING_CLOCK_GETTIME;
+    }
+
+    bool exit_early = false;
+    if (!cli_parse_args(argc, argv, &host, &opts, &exit_early)) {
+        fprintf(stderr, "Try --help for more information.\n");
+        return CLI_EXIT_FAILURE;
+    }
+    if (exit_early) {
+        return CLI_EXIT_SUCCESS;
+    }
+
+    ProfilerParams params = opts.params;
+    if (params.seed_from_time) {
+        params.seed = rand_get_seed_from_time();
+    }
+    profiler_params_recompute_invariants(&params);
+    if (!profiler_params_valid(params)) {
+        fprintf(stderr, "Error: Cannot run profiler: Invalid parameters.\n");
+        return CLI_EXIT_FAILURE;
+    }
+
+    // The TSC frequency is only known after the second call to query_host_info().
+    sleep_ms(CLI_TSC_CALIBRATION_MS);
+    query_host_info(&host);
+
+    ProfilerResult result = profiler_result_create(params);
+    if (!result.valid) {
+        fprintf(stderr, "Error: Failed to allocate memory for profiler run.\n");
+        return CLI_EXIT_FAILURE;
+    }
+
+    if (!opts.quiet) {
+        char ns_desc[64];
+        if (params.ns_kind == RANGE_GEOMETRIC) {
+            snprintf(ns_desc, sizeof(ns_desc), "%u to %u, %u per decade",
+                     params.ns_geom.lower, params.ns_geom.upper, params.ns_geom.per_decade);
+        } else if (params.ns_kind == RANGE_CACHES) {
+            snprintf(ns_desc, sizeof(ns_desc), "%u around each of %u, %u, %u KiB",
+                     params.ns_caches.per_cache,
+                     params.ns_caches.cache_sizes[0] >> 10,
+                     params.ns_caches.cache_sizes[1] >> 10,
+                     params.ns_caches.cache_sizes[2] >> 10);
+        } else {
+            snprintf(ns_desc, sizeof(ns_desc), "%u:%u:%u",
+                     params.ns.lower, params.ns.stride, params.ns.upper);
+        }
+        fprintf(stderr,
+                "Profiling %s (sampler: %s; n = %s (%s); sample size %u; seed %" PRIu64 "; "
+                "timing: %s; repetitions: %u; cache: %s)...\n",
+                targets[params.target_idx].name,
+                samplers[params.sampler_idx].name,
+                ns_desc,
+                range_kind_names[params.ns_kind],
+                params.sample_size,
+                params.seed,
+                timing_methods[params.timing].name_short,
+                params.repetitions,
+                cache_states[params.cache_state].name_short);
+    }
+
+    ProfilerSync sync = {0};  // Unused: the profiler runs on this thread.
+    u64 time_start_ms = get_ostime_ms();
+    profiler_execute(params, result, host, sync);
+    u64 time_elapsed_ms = get_ostime_ms() - time_start_ms;
+
+    if (*result.error != PROFILER_ERROR_NONE) {
+        fprintf(stderr, "Error: Profiler failed: %s\n", profiler_error_descriptions[*result.error]);
+        profiler_result_destroy(&result);
+        return CLI_EXIT_FAILURE;
+    }
+
+    i32 exit_code = CLI_EXIT_SUCCESS;
+    if (!opts.quiet) {
+        fprintf(stderr, "Completed profiler run in %.3f s.\n", (f64)time_elapsed_ms / 1000.0);
+    }
+    if (params.reject_disturbed && !opts.quiet) {
+        fprintf(stderr, "Re-measured %u disturbed measurements.\n", *result.remeasurements);
+    }
+    if (params.lock_memory && !*result.memory_locked && !opts.quiet) {
+        fprintf(stderr, "Warning: Failed to lock memory (see ulimit -l).\n");
+    }
+    if (params.huge_pages != HUGE_PAGES_NONE && !opts.quiet) {
+        fprintf(stderr, "Huge pages: %s (requested: %s).\n",
+                huge_pages_kinds[*result.huge_pages].name_short,
+                huge_pages_kinds[params.huge_pages].name_short);
+    }
+    if ((host.numa_num_nodes > 1 || params.numa_placement != NUMA_ANY) && !opts.quiet) {
+        fprintf(stderr, "NUMA: Worker on node %d, input on node %d (placement: %s).\n",
+                *result.numa_node_worker,
+                *result.numa_node_memory,
+                numa_placements[params.numa_placement].name_short);
+    }
+    if (*result.timed_out && !opts.quiet) {
+        if (*result.groups_valid > 0) {
+            fprintf(stderr, "Run timed out: Measured n up to %.0f (%u of %u values).\n",
+                    result.groups[*result.groups_valid - 1].n,
+                    *result.groups_valid,
+                    params.num_groups);
+        } else {
+            fprintf(stderr, "Run timed out: No value of n was fully measured.\n");
+        }
+    }
+    if (params.verifier_enabled) {
+        bool verified = *result.verification_accept_count == *result.units_published;
+        if (!opts.quiet || !verified) {
+            fprintf(stderr, "Verification %s: Verifier accepted %u/%u units.\n",
+                    verified ? "success" : "failure",
+                    *result.verification_accept_count,
+                    *result.units_published);
+        }
+        if (!verified) {
+            exit_code = CLI_EXIT_VERIFICATION_FAILURE;
+        }
+    }
+
+    // Fit the growth of the median time. The check against the expectation considers only the
+    // basic models, which can be compared with each other.
+    u32 groups_valid = *result.groups_valid;
+    char fit_description[128];
+    ComplexityFit fit = complexity_fit_best(result.groups, groups_valid, true);
+    complexity_fit_describe(fit, fit_description, sizeof(fit_description));
+    if (!opts.quiet) {
+        fprintf(stderr, "Complexity: %s\n", fit_description);
+    }
+    if (opts.expect_complexity) {
+        ComplexityFit fit_basic = complexity_fit_best(result.groups, groups_valid, false);
+        if (!fit_basic.valid) {
+            fprintf(stderr, "Error: Too little data to check the complexity.\n");
+            exit_code = CLI_EXIT_COMPLEXITY_FAILURE;
+        } else if (fit_basic.model > opts.expected_complexity) {
+            complexity_fit_describe(fit_basic, fit_description, sizeof(fit_description));
+            fprintf(stderr, "Complexity failure: Expected %s, but measured %s\n",
+                    complexity_models[opts.expected_complexity].name_long,
+                    fit_description);
+            exit_code = CLI_EXIT_COMPLEXITY_FAILURE;
+        }
+    }
+
+    if (!cli_write_groups(opts.groups_path, params, result)) {
+        exit_code = CLI_EXIT_FAILURE;
+    }
+    if (opts.units_path && !cli_write_units(opts.units_path, params, result)) {
+        exit_code = CLI_EXIT_FAILURE;
+    }
+
+    profiler_result_destroy(&result);
+    return exit_code;
+}
@@ -0,0 +1,242 @@
+// Empirical complexity: least-squares fits of a run's per-n medians to a library of growth models.
+//
+// Each of the basic models is fitted as t = a + b*f(n), where a absorbs the fixed cost of a call
+// (and of the timer). A model only counts if its slope b is significantly positive; if none is,
+// the data is taken to be constant. The power law t = c*n^k is fitted on a log-log scale, and is
+// only preferred to the best basic model if it explains much more of the variance, since its free
+// exponent will always fit at least as well.
+
+
+/**** Types ****/
+
+typedef enum
+{
+    COMPLEXITY_CONSTANT,
+    COMPLEXITY_LOG,
+    COMPLEXITY_LINEAR,
+    COMPLEXITY_NLOGN,
+    COMPLEXITY_QUADRATIC,
+    COMPLEXITY_CUBIC,
+    COMPLEXITY_POWER,
+    COMPLEXITY_MODEL_ID_MAX
+} ComplexityModelID;
+
+typedef struct
+{
+    char const* name_short;  // For the command line.
+    char const* name_long;
+} ComplexityModel;
+
+static ComplexityModel complexity_models[COMPLEXITY_MODEL_ID_MAX] =
+{
+    { "1",     "O(1)" },
+    { "logn",  "O(log n)" },
+    { "n",     "O(n)" },
+    { "nlogn", "O(n log n)" },
+    { "n2",    "O(n²)" },
+    { "n3",    "O(n³)" },
+    { "power", "O(n^k)" },
+};
+
+typedef struct
+{
+    bool valid;  // False if there were too few points to fit anything.
+    ComplexityModelID model;
+    f64 a;  // Intercept; for the power law, the coefficient c.
+    f64 b;  // Slope; unused for the power law.
+    f64 k;  // Exponent; power law only.
+    f64 r2;  // Coefficient of determination, over all the points.
+} ComplexityFit;
+
+
+/**** Constants ****/
+
+// A model's slope must be at least this many standard errors above zero to count as growth.
+#define COMPLEXITY_SLOPE_T_MIN 2.0
+
+// The power law must leave at most this fraction of the best basic model's unexplained variance.
+#define COMPLEXITY_POWER_ADVANTAGE 0.5
+
+
+/**** Functions ****/
+
+// The growth function f(n) of a basic model. For log n, n = 0 counts as n = 1.
+f64 complexity_basis(ComplexityModelID model, f64 n)
+{
+    switch (model) {
+    case COMPLEXITY_CONSTANT:  return 1.0;
+    case COMPLEXITY_LOG:       return log2(MAX(n, 1.0));
+    case COMPLEXITY_LINEAR:    return n;
+    case COMPLEXITY_NLOGN:     return n * log2(MAX(n, 1.0));
+    case COMPLEXITY_QUADRATIC: return n * n;
+    case COMPLEXITY_CUBIC:     return n * n * n;
+    default: {
+        assertm(false, "Not a basic complexity model.");
+        return 0.0;
+    } break;
+    }
+}
+
+// Evaluate the fitted curve at n.
+f64 complexity_evaluate(ComplexityFit fit, f64 n)
+{
+    switch (fit.model) {
+    case COMPLEXITY_CONSTANT: return fit.a;
+    case COMPLEXITY_POWER:    return fit.a * pow(n, fit.k);
+    default:                  return fit.a + fit.b * complexity_basis(fit.model, n);
+    }
+}
+
+// Coefficient of determination of the fit over the groups' medians. With no variance at all,
+// any fit that goes through the points is perfect.
+static f64 complexity_r2(ComplexityFit fit, ProfilerResultGroup const* groups, u32 count)
+{
+    f64 mean = 0.0;
+    for (u32 i = 0; i < count; ++i) {
+        mean += groups[i].time_median;
+    }
+    mean /= count;
+    f64 ss_tot = 0.0;
+    f64 ss_res = 0.0;
+    for (u32 i = 0; i < count; ++i) {
+        f64 y = groups[i].time_median;
+        f64 residual = y - complexity_evaluate(fit, groups[i].n);
+        ss_tot += (y - mean) * (y - mean);
+        ss_res += residual * residual;
+    }
+    if (ss_tot == 0.0) {
+        return ss_res == 0.0 ? 1.0 : 0.0;
+    }
+    return 1.0 - ss_res / ss_tot;
+}
+
+// Fit one model to the groups' medians.
+//
+// Return: false if the model can't be fitted to these points, or (for the basic models other than
+// the constant) if it shows no significant growth.
+//
+bool complexity_fit_model(
+        ComplexityModelID model,
+        ProfilerResultGroup const* groups,
+        u32 count,
+        ComplexityFit* fit)
+{
+    ComplexityFit f = {0};
+    f.model = model;
+    if (model == COMPLEXITY_CONSTANT) {
+        if (count < 1) return false;
+        for (u32 i = 0; i < count; ++i) {
+            f.a += groups[i].time_median;
+        }
+        f.a /= count;
+    } else if (model == COMPLEXITY_POWER) {
+        // Linear regression of log t on log n, over the points where both are defined.
+        u32 m = 0;
+        f64 mean_x = 0.0, mean_y = 0.0;
+        for (u32 i = 0; i < count; ++i) {
+            if (groups[i].n >= 1.0 && groups[i].time_median > 0.0) {
+                mean_x += log(groups[i].n);
+                mean_y += log(groups[i].time_median);
+                ++m;
+            }
+        }
+        if (m < 3) return false;
+        mean_x /= m;
+        mean_y /= m;
+        f64 sxx = 0.0, sxy = 0.0;
+        for (u32 i = 0; i < count; ++i) {
+            if (groups[i].n >= 1.0 && groups[i].time_median > 0.0) {
+                f64 dx = log(groups[i].n) - mean_x;
+                sxx += dx * dx;
+                sxy += dx * (log(groups[i].time_median) - mean_y);
+            }
+        }
+        if (sxx == 0.0) return false;
+        f.k = sxy / sxx;
+        f.a = exp(mean_y - f.k * mean_x);
+    } else {
+        // Ordinary least squares for t = a + b*f(n).
+        if (count < 3) return false;
+        f64 mean_x = 0.0, mean_y = 0.0;
+        for (u32 i = 0; i < count; ++i) {
+            mean_x += complexity_basis(model, groups[i].n);
+            mean_y += groups[i].time_median;
+        }
+        mean_x /= count;
+        mean_y /= count;
+        f64 sxx = 0.0, sxy = 0.0;
+        for (u32 i = 0; i < count; ++i) {
+            f64 dx = complexity_basis(model, groups[i].n) - mean_x;
+            sxx += dx * dx;
+            sxy += dx * (groups[i].time_median - mean_y);
+        }
+        if (sxx == 0.0) return false;
+        f.b = sxy / sxx;
+        f.a = mean_y - f.b * mean_x;
+
+        // Is the slope significantly positive?
+        f64 ss_res = 0.0;
+        for (u32 i = 0; i < count; ++i) {
+            f64 residual = groups[i].time_median - complexity_evaluate(f, groups[i].n);
+            ss_res += residual * residual;
+        }
+        f64 slope_stderr = sqrt(ss_res / (count - 2) / sxx);
+        if (f.b <= 0.0 || f.b < COMPLEXITY_SLOPE_T_MIN * slope_stderr) {
+            return false;
+        }
+    }
+    f.r2 = complexity_r2(f, groups, count);
+    f.valid = true;
+    *fit = f;
+    return true;
+}
+
+// Find the model that best describes the groups' medians (see the comment at the top of this
+// file). If allow_power is false, only the basic models are considered.
+ComplexityFit complexity_fit_best(ProfilerResultGroup const* groups, u32 count, bool allow_power)
+{
+    ComplexityFit best = {0};
+    complexity_fit_model(COMPLEXITY_CONSTANT, groups, count, &best);
+    bool growing = false;
+    for (u32 model = COMPLEXITY_LOG; model <= COMPLEXITY_CUBIC; ++model) {
+        ComplexityFit fit;
+        if (complexity_fit_model((ComplexityModelID)model, groups, count, &fit) &&
+            (!growing || fit.r2 > best.r2)) {
+            best = fit;
+            growing = true;
+        }
+    }
+    ComplexityFit power;
+    if (allow_power && growing &&
+        complexity_fit_model(COMPLEXITY_POWER, groups, count, &power) &&
+        1.0 - power.r2 < COMPLEXITY_POWER_ADVANTAGE * (1.0 - best.r2)) {
+        best = power;
+    }
+    return best;
+}
+
+// Write a description of the fit, such as "O(n log n): 12.3 + 4.56 n log n (R² = 0.999)".
+void complexity_fit_describe(ComplexityFit fit, char* buf, usize buf_len)
+{
+    if (!fit.valid) {
+        snprintf(buf, buf_len, "Not enough data to fit");
+        return;
+    }
+    char const* name = complexity_models[fit.model].name_long;
+    switch (fit.model) {
+    case COMPLEXITY_CONSTANT: {
+        snprintf(buf, buf_len, "%s: %.4g (R² = %.4f)", name, fit.a, fit.r2);
+    } break;
+    case COMPLEXITY_POWER: {
+        snprintf(buf, buf_len, "O(n^%.2f): %.4g n^%.3f (R² = %.4f)",
+                 fit.k, fit.a, fit.k, fit.r2);
+    } break;
+    default: {
+        // The basis function, as in the name, without "O(" and ")".
+        char const* basis = name + 2;
+        i32 basis_len = (i32)strlen(basis) - 1;
+        snprintf(buf, buf_len, "%s: %.4g + %.4g %.*s (R² = %.4f)",
+                 name, fit.a, fit.b, basis_len, basis, fit.r2);
+    } break;
+    }
+}
@@ -39,9 +39,10 @@ void get_cpu_brand(char* brand)
     brand[47] = '\0';  // Just in case.
 }
 
-void get_cpu_tsc_features(bool* has_tsc, bool* has_invariant_tsc)
+void get_cpu_tsc_features(bool* has_tsc, bool* has_rdtscp, bool* has_invariant_tsc)
 {
     *has_tsc = false;
+    *has_rdtscp = false;
     *has_invariant_tsc = false;
 
     // Use CPUID to retrieve support for features.
@@ -53,17 +54,19 @@ void get_cpu_tsc_features(bool* has_tsc, bool* has_invariant_tsc)
     CPUID(regs, 1);
     *has_tsc = regs[3] & (1 << 4);
 
-    /*
+    CPUID(regs, 0x80000000);
+    u32 max_extended_leaf = (u32)regs[0];
+
     // Check support for RDTSCP.
     // (leaf 0x80000001, EDX bit 27)
-    CPUID(regs, 0x80000001);
-    *has_rdtscp = regs[3] & (1 << 27);
-    */
+    if (max_extended_leaf >= 0x80000001) {
+        CPUID(regs, 0x80000001);
+        *has_rdtscp = regs[3] & (1 << 27);
+    }
 
     // Check for invariant TSC.
-    // (leaf 0x80000001, EDX bit 8)
-    CPUID(regs, 0x80000000);
-    bool has_extended_features = (u32)regs[0] >= 0x80000007;
+    // (leaf 0x80000007, EDX bit 8)
+    bool has_extended_features = max_extended_leaf >= 0x80000007;
     if (has_extended_features) {
         CPUID(regs, 0x80000007);
         *has_invariant_tsc = regs[3] & (1 << 8);
@@ -154,3 +157,173 @@ u32 get_cpu_num_logical_processors()
 #endif
     return num_cores;
 }
+
+// Find one logical processor on each physical core, so that threads pinned to them don't share a
+// core (via SMT/Hyper-Threading). Write up to `max_count` logical processor IDs to `cpu_ids`, in
+// increasing order, and return the number written.
+//
+// If the topology can't be determined, every logical processor is assumed to be its own core.
+u32 get_cpu_physical_core_ids(u32* cpu_ids, u32 max_count)
+{
+    u32 count = 0;
+#ifdef _WIN32
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION info[256];
+    DWORD info_len = sizeof(info);
+    if (GetLogicalProcessorInformation(info, &info_len)) {
+        u32 info_count = (u32)(info_len / sizeof(info[0]));
+        for (u32 i = 0; i < info_count && count < max_count; ++i) {
+            if (info[i].Relationship != RelationProcessorCore || !info[i].ProcessorMask) {
+                continue;
+            }
+            // Take the lowest logical processor on this core.
+            u32 cpu_id = 0;
+            while (!(info[i].ProcessorMask & ((ULONG_PTR)1 << cpu_id))) {
+                ++cpu_id;
+            }
+            cpu_ids[count++] = cpu_id;
+        }
+    }
+#else
+    u32 num_cpus_conf = (u32)sysconf(_SC_NPROCESSORS_CONF);
+    for (u32 cpu_id = 0; cpu_id < num_cpus_conf && count < max_count; ++cpu_id) {
+        char path[96] = {0};
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/online", cpu_id);
+        FILE* f = fopen(path, "r");
+        if (f) {
+            // (cpu0 usually has no "online" file, because it can't be taken offline.)
+            i32 online = 1;
+            if (fscanf(f, "%d", &online) != 1) {
+                online = 1;
+            }
+            fclose(f);
+            if (!online) {
+                continue;
+            }
+        }
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%u/topology/thread_siblings_list", cpu_id);
+        f = fopen(path, "r");
+        u32 first_sibling = cpu_id;
+        if (f) {
+            // The list looks like "3,19" or "2-3"; the first entry is the lowest ID.
+            if (fscanf(f, "%u", &first_sibling) != 1) {
+                first_sibling = cpu_id;
+            }
+            fclose(f);
+        }
+        if (first_sibling == cpu_id) {
+            cpu_ids[count++] = cpu_id;
+        }
+    }
+#endif
+    if (count == 0) {
+        // Unknown topology.
+        u32 num_cpus = MIN(get_cpu_num_logical_processors(), max_count);
+        for (u32 cpu_id = 0; cpu_id < num_cpus; ++cpu_id) {
+            cpu_ids[count++] = cpu_id;
+        }
+    }
+    return count;
+}
+
+// Find the number of NUMA nodes, and the node of each of the `count` logical processors in
+// `cpu_ids`, which are written to `nodes`. Node IDs may have gaps; the count is one more than the
+// highest ID. Bit k of `memory_nodes` is set if node k exists and has memory (only the first 64
+// nodes are considered).
+//
+// If there's no NUMA (or it can't be determined), there's one node, and every processor is on it.
+u32 get_numa_nodes(u32 const* cpu_ids, u32* nodes, u32 count, u64* memory_nodes)
+{
+    #define NUMA_NODES_MAX 64
+    u32 num_nodes = 1;
+    *memory_nodes = 1;
+    for (u32 i = 0; i < count; ++i) {
+        nodes[i] = 0;
+    }
+#ifdef _WIN32
+    ULONG highest_node = 0;
+    if (GetNumaHighestNodeNumber(&highest_node)) {
+        num_nodes = (u32)highest_node + 1;
+        for (u32 i = 0; i < count; ++i) {
+            UCHAR node = 0;
+            if (cpu_ids[i] < 256 && GetNumaProcessorNode((UCHAR)cpu_ids[i], &node)) {
+                nodes[i] = node;
+            }
+        }
+        u64 found = 0;
+        for (u32 node = 0; node < MIN(num_nodes, NUMA_NODES_MAX); ++node) {
+            ULONGLONG available = 0;
+            if (GetNumaAvailableMemoryNodeEx((USHORT)node, &available) && available > 0) {
+                found |= 1ull << node;
+            }
+        }
+        if (found) {
+            *memory_nodes = found;
+        }
+    }
+#else
+    u64 nodes_present = 0;
+    for (u32 node = 0; node < NUMA_NODES_MAX; ++node) {
+        char path[64] = {0};
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+        FILE* f = fopen(path, "r");
+        if (!f) {
+            continue;
+        }
+        num_nodes = node + 1;
+        nodes_present |= 1ull << node;
+        // The list looks like "0-7,16-23" (or is empty, for a node with memory but no CPUs).
+        u32 first = 0;
+        while (fscanf(f, "%u", &first) == 1) {
+            u32 last = first;
+            i32 c = fgetc(f);
+            if (c == '-') {
+                if (fscanf(f, "%u", &last) != 1) {
+                    break;
+                }
+                c = fgetc(f);
+            }
+            for (u32 i = 0; i < count; ++i) {
+                if (first <= cpu_ids[i] && cpu_ids[i] <= last) {
+                    nodes[i] = node;
+                }
+            }
+            if (c != ',') {
+                break;
+            }
+        }
+        fclose(f);
+    }
+    // The nodes with memory are listed like the CPUs above, e.g., "0-1". Without the list, take
+    // every node to have memory.
+    u64 nodes_with_memory = 0;
+    FILE* f = fopen("/sys/devices/system/node/has_memory", "r");
+    if (f) {
+        u32 first = 0;
+        while (fscanf(f, "%u", &first) == 1) {
+            u32 last = first;
+            i32 c = fgetc(f);
+            if (c == '-') {
+                if (fscanf(f, "%u", &last) != 1) {
+                    break;
+                }
+                c = fgetc(f);
+            }
+            for (u32 node = first; node <= last && node < NUMA_NODES_MAX; ++node) {
+                nodes_with_memory |= 1ull << node;
+            }
+            if (c != ',') {
+                break;
+            }
+        }
+        fclose(f);
+    } else {
+        nodes_with_memory = nodes_present;
+    }
+    if (nodes_with_memory) {
+        *memory_nodes = nodes_with_memory;
+    }
+#endif
+    #undef NUMA_NODES_MAX
+    return num_nodes;
+}
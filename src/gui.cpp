@@ -20,13 +20,23 @@
 #include "util_thread.c"
 #include "logger.c"
 #include "cpuinfo.c"
+#include "perfcounter.c"
 #include "problems/sort.c"  // Choose one problem here (compiled in, for now).
 #include "profiler.c"
+#include "complexity.c"
 
 
 /**** Constants ****/
 
-#define GLOBAL_ARENA_SIZE 1024*1024*10
+// Address space to reserve for the global arena; memory is only committed as it's used.
+#define GLOBAL_ARENA_SIZE 1024*1024*1024
+
+// Upper bound for the number of profiler worker threads running at once.
+#define PROFILER_WORKERS_MAX 64
+
+// How long the watchdog lets a worker process go without progress beyond its unit timeout, before
+// killing it. This covers the work the profiler does between units, and the GUI's frame time.
+#define PROFILER_WATCHDOG_GRACE_MS 2000
 
 
 /**** Types ****/
@@ -42,9 +52,13 @@ typedef struct
     bool visible_data_mean;
     bool visible_data_median;
     bool visible_data_bounds;
+    bool visible_data_ci;
+    bool visible_data_percentiles;
+    bool visible_data_fit;
     bool auto_zoom;
     bool live_view;
     bool log_show_timestamps;
+    u32 profiler_workers;  // How many profiler runs may execute concurrently.
 } GuiConfig;
 
 // The user's settings for the GUI's styling.
@@ -81,7 +95,17 @@ typedef struct
 {
     u64 id;  // Unique; 1-indexed; id==0 indicates stub (uninitialized, or already destroyed).
     ProfRunState state;     // Once this is PROFRUN_DONE_..., `result` is safe to read.
-    THREAD thread_handle;   // A handle to the profiler thread/process.
+    THREAD thread_handle;   // A handle to the profiler thread...
+    PROCESS process_handle; // ... or process (see profiler_params_in_process()).
+    bool worker_crashed;    // The profiler process died before completing the run.
+    u64 start_ms;           // When the worker was started (see get_ostime_ms()).
+    u64 watchdog_progress;  // Invocations completed when the watchdog last saw progress...
+    u64 watchdog_ms;        // ... and when that was.
+    bool watchdog_fired;    // The watchdog killed the profiler process for running over time.
+    bool timed_out;         // The run was cut short by its time limits; see ProfilerParams.
+    ComplexityFit fit;      // Best model for the growth of the median; made when the run completes.
+    u32 worker_idx;         // The worker slot the run executes on.
+    u32 worker_cpu_id;      // The logical processor that the worker is pinned to.
     ProfilerSync sync;      // For talking with the profiler thread/process.
     ProfilerParams params;
     ProfilerResult result;  // Written directly by profiler thread: Beware data races.
@@ -90,6 +114,14 @@ typedef struct
 } Profrun;
 typedef_darray(Profrun, profrun);
 
+// A slot in the pool of profiler workers. Each slot is pinned to its own physical core.
+typedef struct
+{
+    bool busy;
+    u32 cpu_id;  // Logical processor that the worker thread/process is pinned to.
+    u32 volatile abort_flag;  // Pointed to by the ProfilerSync of the run using this slot.
+} ProfilerWorker;
+
 
 /****  Functions ****/
 
@@ -147,33 +179,89 @@ bool profrun_actually_visible(Profrun* run, bool live_view)
     return data_available && run->intent_visible;
 }
 
+// Write the name under which the run is listed and plotted: the target's name, followed by the
+// cache state unless it's the default.
+void profrun_name(ProfilerParams const* params, char* buf, usize buf_len)
+{
+    if (params->cache_state == CACHE_HOT) {
+        snprintf(buf, buf_len, "%s", targets[params->target_idx].name);
+    } else {
+        snprintf(buf, buf_len, "%s (%s)",
+                 targets[params->target_idx].name, cache_states[params->cache_state].name_short);
+    }
+}
+
 // Perform some state transitions, logging, and basic cleanup.
 // This function should be called after the profiler exits the run.
 void profiler_worker_finish(Logger* l, Profrun* run)
 {
     if (run->state == PROFRUN_ABORTING) {
         run->state = PROFRUN_DONE_ABORTED;
+    } else if (run->worker_crashed) {
+        // Already logged by the caller, which knows why.
+        run->state = PROFRUN_DONE_FAILURE;
     } else if (!run->result.valid){
         logger_append(l, LOG_LEVEL_ERROR, "Profiler failed to run.");
         run->state = PROFRUN_DONE_FAILURE;
+    } else if (*(run->result.error) != PROFILER_ERROR_NONE) {
+        logger_appendf(l, LOG_LEVEL_ERROR,
+                       "(ID %" PRIu64 ") Profiler failed: %s",
+                       run->id,
+                       profiler_error_descriptions[*(run->result.error)]);
+        run->state = PROFRUN_DONE_FAILURE;
     } else {
+        run->timed_out = *(run->result.timed_out) || run->watchdog_fired;
+        if (atomic_load_u32(run->result.groups_seq) & 1) {
+            // The watchdog killed the profiler while it was publishing a group (see
+            // profiler_result_publish_group()), so the groups may be torn, and nothing we could
+            // read from them can be trusted. From now on, they're read without the seqlock.
+            logger_appendf(l, LOG_LEVEL_WARN,
+                           "(ID %" PRIu64 ") Run was killed while publishing its results; "
+                           "discarding them.",
+                           run->id);
+            *(run->result.groups_valid) = 0;
+        }
+        if (run->timed_out) {
+            u32 groups_valid = *(run->result.groups_valid);
+            if (groups_valid > 0) {
+                logger_appendf(l, LOG_LEVEL_WARN,
+                               "(ID %" PRIu64 ") Run timed out: Measured n up to %.0f "
+                               "(%u of %u values).",
+                               run->id,
+                               run->result.groups[groups_valid - 1].n,
+                               groups_valid,
+                               run->params.num_groups);
+            } else {
+                logger_appendf(l, LOG_LEVEL_WARN,
+                               "(ID %" PRIu64 ") Run timed out: No value of n was fully measured.",
+                               run->id);
+            }
+        }
         if (run->params.verifier_enabled) {
-            if (*(run->result.verification_accept_count) == run->params.num_units) {
+            u32 units_verified = *(run->result.units_published);
+            if (*(run->result.verification_accept_count) == units_verified) {
                 logger_appendf(
                         l, LOG_LEVEL_INFO,
                         "(ID %" PRIu64 ") Verification success: Verifier accepted %u/%u units.",
                         run->id,
                         *(run->result.verification_accept_count),
-                        run->params.num_units);
+                        units_verified);
             } else {
                 logger_appendf(
                         l, LOG_LEVEL_INFO,
                         "(ID %" PRIu64 ") Verification failure: Verifier accepted %u/%u units.",
                         run->id,
                         *(run->result.verification_accept_count),
-                        run->params.num_units);
+                        units_verified);
             }
         }
+        run->fit = complexity_fit_best(run->result.groups, *(run->result.groups_valid), true);
+        if (run->fit.valid) {
+            char fit_description[128];
+            complexity_fit_describe(run->fit, fit_description, sizeof(fit_description));
+            logger_appendf(l, LOG_LEVEL_INFO, "(ID %" PRIu64 ") Complexity: %s",
+                           run->id, fit_description);
+        }
         logger_appendf(l, LOG_LEVEL_INFO, "(ID %" PRIu64 ") Completed profiler run.", run->id);
         run->fresh = true;
         run->state = PROFRUN_DONE_SUCCESS;
@@ -181,20 +269,20 @@ void profiler_worker_finish(Logger* l, Profrun* run)
 }
 
 // This function should be invoked frequently, to perform bookkeeping on `runs` and their associated
-// profiler threads/process(es).
+// profiler threads/processes. At most `workers_max` workers run at once, each pinned to its own
+// physical core.
 void manage_profiler_workers(
         Logger* l,
         HostInfo* host,
-        darray_profrun* runs)
+        darray_profrun* runs,
+        u32 workers_max)
 {
-    // Only one worker thread at a time for now, because memory (scratch) arenas are not
-    // thread-safe.
-    u32 workers_available = 1;
-    #ifndef _WIN32
-    // pthread mutexes and conds must share a single memory location across all threads.
-    static pthread_event_t abort_event;
-    static pthread_mutex_t result_mutex;
-    #endif
+    // The worker slots must persist across calls: the worker threads hold pointers into them.
+    // (Worker processes have their own copies, so they can only be aborted by killing them.)
+    static ProfilerWorker workers[PROFILER_WORKERS_MAX] = {0};
+    workers_max = CLAMP(workers_max, 1, MIN(PROFILER_WORKERS_MAX, host->cpu_num_physical_cores));
+    u32 workers_busy = 0;
+    bool run_alone_busy = false;  // A running worker has asked for the machine to itself.
     bool state_changed_this_frame = false;
 
     // Take care of already-running worker(s).
@@ -204,22 +292,82 @@ void manage_profiler_workers(
             assertm(run->params.separate_thread, "Worker shouldn't have its own thread.");
             logger_appendf(l, LOG_LEVEL_DEBUG,
                            "(ID %" PRIu64 ") Profiler abort requested.", run->id);
-            event_signal(run->sync.abort_event);
+            #ifndef _WIN32
+            if (profiler_params_in_process(run->params)) {
+                process_kill(run->process_handle);
+            } else
+            #endif
+            {
+                atomic_store_u32(run->sync.abort_flag, 1);
+            }
             run->state = PROFRUN_ABORTING;
             state_changed_this_frame = true;
         }
         if (profrun_busy(run)) {
             assertm(run->params.separate_thread, "Worker shouldn't have its own thread.");
-            assertm(workers_available > 0, "Too many profiler workers running.");
-            bool run_completed = thread_has_joined(run->thread_handle);
+            bool run_completed = false;
+            #ifndef _WIN32
+            if (profiler_params_in_process(run->params)) {
+                i32 exit_code = 0;
+                i32 signal_num = 0;
+                run_completed = process_has_exited(run->process_handle, &exit_code, &signal_num);
+                if (run_completed && exit_code != 0 && run->state != PROFRUN_ABORTING &&
+                    !run->watchdog_fired) {
+                    run->worker_crashed = true;
+                    if (signal_num != 0) {
+                        logger_appendf(l, LOG_LEVEL_ERROR,
+                                       "(ID %" PRIu64 ") Profiler process was killed by signal "
+                                       "%d (%s).",
+                                       run->id, signal_num, strsignal(signal_num));
+                    } else {
+                        logger_appendf(l, LOG_LEVEL_ERROR,
+                                       "(ID %" PRIu64 ") Profiler process failed (exit code %d).",
+                                       run->id, exit_code);
+                    }
+                }
+            } else
+            #endif
+            {
+                run_completed = thread_has_joined(run->thread_handle);
+            }
+            #ifndef _WIN32
+            if (!run_completed && run->state == PROFRUN_RUNNING && !run->watchdog_fired &&
+                profiler_params_in_process(run->params)) {
+                // Watchdog: the profiler itself only checks its time limits between units, so
+                // it can't stop a unit that runs (nearly) forever. We can, by killing it.
+                u64 now_ms = get_ostime_ms();
+                u64 progress = atomic_load_u64(run->result.invocations_completed);
+                if (progress != run->watchdog_progress) {
+                    run->watchdog_progress = progress;
+                    run->watchdog_ms = now_ms;
+                }
+                bool stalled =
+                    run->params.unit_timeout_ms != 0 &&
+                    now_ms - run->watchdog_ms >
+                        (u64)run->params.unit_timeout_ms + PROFILER_WATCHDOG_GRACE_MS;
+                bool over_budget =
+                    run->params.run_budget_s != 0 &&
+                    now_ms - run->start_ms >
+                        1000ull * run->params.run_budget_s + PROFILER_WATCHDOG_GRACE_MS;
+                if (stalled || over_budget) {
+                    logger_appendf(l, LOG_LEVEL_WARN,
+                                   "(ID %" PRIu64 ") Profiler process is over its %s; killing it.",
+                                   run->id, stalled ? "unit timeout" : "run budget");
+                    process_kill(run->process_handle);
+                    run->watchdog_fired = true;
+                }
+            }
+            #endif
             if (!run_completed) {
-                --workers_available;
+                ++workers_busy;
+                if (run->params.run_alone) {
+                    run_alone_busy = true;
+                }
             } else {
                 #ifdef _WIN32
                 CloseHandle(run->thread_handle);
                 #endif
-                event_destroy(run->sync.abort_event);
-                mutex_destroy(run->sync.result_mutex);
+                workers[run->worker_idx].busy = false;
                 profiler_worker_finish(l, run);
                 if (run->state == PROFRUN_DONE_ABORTED) {
                     if (profrun_try_delete(l, runs, i)) {
@@ -230,14 +378,21 @@ void manage_profiler_workers(
             }
         }
     }
+    assertm(workers_busy <= PROFILER_WORKERS_MAX, "Too many profiler workers running.");
 
     // Begin new worker(s).
     for (usize i = 0; i < runs->len; ++i) {
-        if (!workers_available) {
+        if (workers_busy >= workers_max || run_alone_busy) {
             break;
         }
         Profrun* run = &runs->data[i];
         if (run->state == PROFRUN_PENDING) {
+            bool run_alone = run->params.run_alone || !run->params.separate_thread;
+            if (run_alone && workers_busy > 0) {
+                // Wait for the other workers to finish. Do not begin any later runs in the
+                // meantime, either (we always go in order queued).
+                break;
+            }
             if (!run->params.separate_thread && state_changed_this_frame) {
                 // Wait for one GUI frame to update the GUI before blocking the thread. This
                 // is so that the results list and graph get a chance to update.
@@ -247,15 +402,26 @@ void manage_profiler_workers(
             logger_appendf(l, LOG_LEVEL_INFO,
                            "(ID %" PRIu64 ") Starting profiler run.", run->id);
             if (run->params.separate_thread) {
-                // Create the worker thread.
+                // Claim a free worker slot. Slot k is pinned to the k-th physical core counting
+                // from the top, leaving the lowest cores (which tend to service interrupts and
+                // run the GUI) for last.
+                u32 worker_idx = 0;
+                while (workers[worker_idx].busy) {
+                    ++worker_idx;
+                }
+                assertm(worker_idx < workers_max, "No free profiler worker slot.");
+                ProfilerWorker* worker = &workers[worker_idx];
+                worker->cpu_id = host->cpu_core_ids[host->cpu_num_physical_cores - 1 - worker_idx];
+                run->worker_idx = worker_idx;
+                run->worker_cpu_id = worker->cpu_id;
+                worker->abort_flag = 0;
+                run->sync.abort_flag = &worker->abort_flag;
 
-                // NOTE The platform-specific organization is messy, but we're going to tear
-                // this all out when we switch from threads to processes.
+                // Create the worker thread (Windows), or the worker process (Linux) unless the
+                // user asked for a thread.
 
                 #ifdef _WIN32
 
-                run->sync.abort_event = CreateEvent(NULL, TRUE, FALSE, NULL);
-                run->sync.result_mutex = CreateMutex(NULL, FALSE, NULL);
                 // Don't leave this stack frame until the child thread is done with it.
                 THREAD_EVENT done_copying_args = CreateEvent(NULL, TRUE, FALSE, NULL);
                 profiler_execute_args_struct profiler_args = {
@@ -263,6 +429,8 @@ void manage_profiler_workers(
                     run->result,
                     *host,
                     run->sync,
+                    true,
+                    worker->cpu_id,
                     done_copying_args
                 };
                 run->thread_handle = (THREAD)_beginthreadex(
@@ -277,7 +445,8 @@ void manage_profiler_workers(
                     ResumeThread(run->thread_handle);
                     // Wait until it's safe for profiler_args to go out of scope.
                     event_wait(profiler_args.done_copying_args);
-                    --workers_available;
+                    worker->busy = true;
+                    ++workers_busy;
                     run->state = PROFRUN_RUNNING;
                 }
                 CloseHandle(profiler_args.done_copying_args);
@@ -285,43 +454,74 @@ void manage_profiler_workers(
                 #else
                 // Linux:
 
-                // Here, unlike in Win32, we can't copy around mutexes and events/conds across
-                // threads: each thread must hold a pointer to a single, shared object.
-                event_initialize(&abort_event);
-                mutex_initialize(&result_mutex);
-                run->sync.abort_event = &abort_event;
-                run->sync.result_mutex = &result_mutex;
-                // Don't leave this stack frame until the child thread is done with it.
-                pthread_event_t done_copying_args;
-                event_initialize(&done_copying_args);
-                profiler_execute_args_struct profiler_args = {
-                    run->params,
-                    run->result,
-                    *host,
-                    run->sync,
-                    &done_copying_args
-                };
-                i32 rtn = pthread_create(
-                        &run->thread_handle, NULL, profiler_execute_begin, &profiler_args);
-                if (rtn != 0) {
-                    logger_appendf(l, LOG_LEVEL_ERROR,
-                                   "(ID %" PRIu64 ") Failed to start profiler thread.", run->id);
-                    run->state = PROFRUN_DONE_FAILURE;
+                if (profiler_params_in_process(run->params)) {
+                    run->sync.abort_flag = NULL;
+                    run->process_handle = profiler_execute_fork(
+                            run->params, run->result, *host, worker->cpu_id);
+                    if (run->process_handle < 0) {
+                        logger_appendf(l, LOG_LEVEL_ERROR,
+                                       "(ID %" PRIu64 ") Failed to start profiler process.",
+                                       run->id);
+                        run->state = PROFRUN_DONE_FAILURE;
+                    } else {
+                        // Only the child writes the result; catch any stray write on our side.
+                        arena_set_readonly(&run->result.local_arena);
+                        worker->busy = true;
+                        ++workers_busy;
+                        run->state = PROFRUN_RUNNING;
+                    }
                 } else {
-                    // On Linux, setting high thread priority on threads requires superuser
-                    // permissions, so we skip it.
-                    event_wait(&done_copying_args);  // Don't pop stack frame until it's safe.
-                    --workers_available;
-                    run->state = PROFRUN_RUNNING;
+                    // Don't leave this stack frame until the child thread is done with it.
+                    pthread_event_t done_copying_args;
+                    event_initialize(&done_copying_args);
+                    profiler_execute_args_struct profiler_args = {
+                        run->params,
+                        run->result,
+                        *host,
+                        run->sync,
+                        true,
+                        worker->cpu_id,
+                        &done_copying_args
+                    };
+                    i32 rtn = pthread_create(
+                            &run->thread_handle, NULL, profiler_execute_begin, &profiler_args);
+                    if (rtn != 0) {
+                        logger_appendf(l, LOG_LEVEL_ERROR,
+                                       "(ID %" PRIu64 ") Failed to start profiler thread.",
+                                       run->id);
+                        run->state = PROFRUN_DONE_FAILURE;
+                    } else {
+                        // On Linux, setting high thread priority on threads requires superuser
+                        // permissions, so we skip it.
+                        event_wait(&done_copying_args);  // Don't pop stack frame until it's safe.
+                        worker->busy = true;
+                        ++workers_busy;
+                        run->state = PROFRUN_RUNNING;
+                    }
                 }
 
                 #endif
+                if (run->state == PROFRUN_RUNNING) {
+                    run->start_ms = get_ostime_ms();
+                    // The warmup makes no visible progress, so don't hold it against the run.
+                    run->watchdog_progress = 0;
+                    run->watchdog_ms = run->start_ms + run->params.warmup_ms;
+                    logger_appendf(l, LOG_LEVEL_DEBUG,
+                                   "(ID %" PRIu64 ") Profiler worker %u pinned to processor %u.",
+                                   run->id, worker_idx, worker->cpu_id);
+                    if (run->params.run_alone) {
+                        run_alone_busy = true;
+                    }
+                }
             } else {
                 // User requested to use GUI thread for the profiler.
                 run->state = PROFRUN_RUNNING;
                 // This will block until the run is complete.
                 profiler_execute(run->params, run->result, *host, run->sync);
+                // Don't hold on to the run's (possibly very large) scratch memory.
+                scratch_destroy_all();
                 profiler_worker_finish(l, run);
+                state_changed_this_frame = true;
             }
         }
     }
@@ -544,6 +744,60 @@ bool ImGuiDragRangeWithStride(
     return value_changed;
 }
 
+// Like ImGuiDragRangeWithStride(), but for a geometric range: the middle field is the number of
+// values per decade. The bounds are dragged logarithmically.
+bool ImGuiDragRangeGeometric(
+        const char* label,
+        range_geom_u32* v_current,
+        u32 v_max_bounds = U32_MAX,
+        u32 v_max_per_decade = 1000,
+        const char* format_lower = "%u",
+        const char* format_per_decade = "%u",
+        const char* format_upper = "%u",
+        ImGuiSliderFlags flags = 0)
+{
+    ImGuiStyle& style = ImGui::GetStyle();
+    bool value_changed = false;
+    flags |= ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_ClampZeroRange;
+    ImGui::PushID(label);
+    ImGui::BeginGroup();
+    ImGui::PushMultiItemsWidths(3, ImGui::CalcItemWidth());
+
+    if (ImGuiDragU32("##lower", &v_current->lower, 1.0f,
+                1, v_current->upper, format_lower, flags | ImGuiSliderFlags_Logarithmic)) {
+        value_changed = true;
+        v_current->upper = MAX(v_current->lower, v_current->upper);
+    }
+    ImGui::PopItemWidth();
+    ImGui::SameLine(0, style.ItemInnerSpacing.x);
+
+    if (ImGuiDragU32("##per_decade", &v_current->per_decade, 0.2f,
+                1, v_max_per_decade, format_per_decade, flags)) {
+        value_changed = true;
+    }
+    ImGui::PopItemWidth();
+    ImGui::SameLine(0, style.ItemInnerSpacing.x);
+
+    if (ImGuiDragU32("##upper", &v_current->upper, 1.0f,
+                v_current->lower, v_max_bounds, format_upper,
+                flags | ImGuiSliderFlags_Logarithmic)) {
+        value_changed = true;
+        v_current->lower = MIN(v_current->lower, v_current->upper);
+    }
+    ImGui::PopItemWidth();
+    ImGui::SameLine(0, style.ItemInnerSpacing.x);
+
+    ImGui::TextEx(label, ImGui::FindRenderedTextEnd(label));
+    ImGui::EndGroup();
+    ImGui::PopID();
+
+    // Don't trust the ImGui widgets; do it ourselves to be very sure.
+    v_current->upper = MIN(v_current->upper, v_max_bounds);
+    v_current->per_decade = MIN(v_current->per_decade, v_max_per_decade);
+    range_geom_u32_repair(v_current);
+    return value_changed;
+}
+
 
 /**** Our windows ****/
 
@@ -601,6 +855,10 @@ void show_profiler_windows(
     ImGui::Begin("Profiler" /*, visible*/);
 
     static ProfilerParams next_run_params = profiler_params_default();
+    // The percentiles are edited as text, which is applied whenever it makes a valid list.
+    static char percentiles_text[128] = {0};
+    static bool percentiles_text_stale = true;  // Out of date with next_run_params.
+    static bool percentiles_text_valid = true;
 
     f32 icon_width = ImGui::GetFrameHeightWithSpacing();
     f32 option_width = ImGui::GetFontSize() * 12;
@@ -640,17 +898,81 @@ void show_profiler_windows(
         ImGui::PushItemWidth(option_width);
 
         TextIcon(ICON_LC_TALLY_5); ImGui::SameLine(icon_width);
-        if (ImGuiDragRangeWithStride(
-                    "Range for n",
-                    &next_run_params.ns,
-                    10.0f, 1.0f,
-                    0, U32_MAX,
-                    1, U32_MAX,
-                    "Min: %u",
-                    "Stride: %u",
-                    "Max: %u")) {
+        if (next_run_params.ns_kind == RANGE_ARITHMETIC) {
+            if (ImGuiDragRangeWithStride(
+                        "Range for n",
+                        &next_run_params.ns,
+                        10.0f, 1.0f,
+                        0, U32_MAX,
+                        1, U32_MAX,
+                        "Min: %u",
+                        "Stride: %u",
+                        "Max: %u")) {
+                profiler_params_recompute_invariants(&next_run_params);
+            }
+        } else if (next_run_params.ns_kind == RANGE_GEOMETRIC) {
+            if (ImGuiDragRangeGeometric(
+                        "Range for n",
+                        &next_run_params.ns_geom,
+                        U32_MAX,
+                        1000,
+                        "Min: %u",
+                        "Per decade: %u",
+                        "Max: %u")) {
+                profiler_params_recompute_invariants(&next_run_params);
+            }
+        } else {
+            if (ImGuiDragU32(
+                        "Values of n for each cache",
+                        &next_run_params.ns_caches.per_cache,
+                        0.2f, 1, PROFILER_CACHE_SWEEP_PER_CACHE_MAX, "%u",
+                        ImGuiSliderFlags_AlwaysClamp)) {
+                cache_sweep_repair(&next_run_params.ns_caches);
+                profiler_params_recompute_invariants(&next_run_params);
+            }
+        }
+        TextIconGhost(); ImGui::SameLine(icon_width);
+        for (u32 i = 0; i < RANGE_KIND_ID_MAX; ++i) {
+            if (i != 0) {
+                ImGui::SameLine();
+            }
+            if (ImGui::RadioButton(range_kind_names[i],
+                                   next_run_params.ns_kind == (RangeKindID)i)) {
+                next_run_params.ns_kind = (RangeKindID)i;
+                if (next_run_params.ns_kind == RANGE_CACHES) {
+                    cache_sweep_from_host(&next_run_params.ns_caches, host);
+                }
+                profiler_params_recompute_invariants(&next_run_params);
+            }
+        }
+        ImGui::SameLine(); HelpMarker(
+                "Arithmetic: Step n by a fixed stride."
+                "\n\n"
+                "Geometric: Space the values of n evenly on a logarithmic scale, with a fixed "
+                "number of values for every factor of 10 (rounded to integers, without repeats; "
+                "the maximum is always included). This covers a range such as 10 to 100,000,000 "
+                "in a reasonable number of steps, while keeping detail at small n."
+                "\n\n"
+                "Around caches: Take n densely around each of this CPU's data cache sizes (see "
+                "Host), so that the input and output together range from half to twice the size "
+                "of each cache. This shows where the target falls off each level of the cache "
+                "hierarchy. There are no values of n if the cache sizes couldn't be detected.");
+
+        TextIconGhost(); ImGui::SameLine(icon_width);
+        if (ImGuiDragU32(
+                    "Refine with extra values of n",
+                    &next_run_params.refine_points,
+                    0.2f, 0, 10000, "%u",
+                    ImGuiSliderFlags_AlwaysClamp)) {
             profiler_params_recompute_invariants(&next_run_params);
         }
+        ImGui::SameLine(); HelpMarker(
+                "After measuring the range, measure up to this many more values of n in a second "
+                "pass, placed between the existing ones wherever the curve of the medians bends "
+                "most sharply (such as where the input outgrows a cache). Each new value "
+                "halves a gap, so several may go into the same gap."
+                "\n\n"
+                "Set this to zero to measure only the range.");
 
         TextIconGhost(); ImGui::SameLine(icon_width);
         if (ImGuiDragU32(
@@ -662,10 +984,71 @@ void show_profiler_windows(
         }
         TextIconGhost(); ImGui::SameLine(icon_width);
         ImGui::Text(
-                u8"Sampler will be invoked %u × %u = %u times.",
+                u8"Sampler will be invoked %s%u × %u = %u times.",
+                (next_run_params.precision_pct > 0.0f || next_run_params.refine_points != 0)
+                ? "at most " : "",
                 next_run_params.num_groups,
                 next_run_params.sample_size,
                 next_run_params.num_units);
+
+        TextIcon(ICON_LC_GAUGE); ImGui::SameLine(icon_width);
+        ImGui::DragFloat(
+                "Adaptive precision (%)",
+                &next_run_params.precision_pct,
+                0.1f, 0.0f, 100.0f, "%.1f",
+                ImGuiSliderFlags_AlwaysClamp);
+        ImGui::SameLine(); HelpMarker(
+                "Adaptive sampling: Stop taking units for each n as soon as the 95% confidence "
+                "interval for the mean time is within this many percent of the mean, so that "
+                "quiet values of n are done quickly and noisy ones get more units. The sample "
+                "size above becomes the most units for each n."
+                "\n\n"
+                "The decision is made in the first repetition; later repetitions measure the same "
+                "units again."
+                "\n\n"
+                "Set this to zero to take the full sample size for every n.");
+
+        ImGui::BeginDisabled(next_run_params.precision_pct <= 0.0f);
+        TextIconGhost(); ImGui::SameLine(icon_width);
+        ImGuiDragU32(
+                "Minimum sample size",
+                &next_run_params.sample_size_min,
+                1, 2, U32_MAX, "%u",
+                ImGuiSliderFlags_AlwaysClamp);
+        ImGui::SameLine(); HelpMarker(
+                "Adaptive sampling: Take at least this many units for each n, however quickly the "
+                "mean seems to converge; a few lucky units can make the confidence interval look "
+                "much narrower than it is.");
+        TextIconGhost(); ImGui::SameLine(icon_width);
+        ImGui::Checkbox("Converge on median", &next_run_params.precision_of_median);
+        ImGui::SameLine(); HelpMarker(
+                "Adaptive sampling: Use the confidence interval for the median instead of the "
+                "mean. A few extreme outliers (e.g., units that were pre-empted by the operating "
+                "system) can keep the mean from ever converging, but hardly move the median.");
+        ImGui::EndDisabled();
+
+        TextIconGhost(); ImGui::SameLine(icon_width);
+        if (percentiles_text_stale) {
+            profiler_params_format_percentiles(
+                    next_run_params, percentiles_text, sizeof(percentiles_text));
+            percentiles_text_stale = false;
+            percentiles_text_valid = true;
+        }
+        if (ImGui::InputText("Percentiles", percentiles_text, sizeof(percentiles_text))) {
+            percentiles_text_valid =
+                profiler_params_parse_percentiles(&next_run_params, percentiles_text);
+        }
+        ImGui::SameLine(); HelpMarker(
+                "Percentiles of each value of n to report besides the median, separated by "
+                "commas, in increasing order and strictly between 0 and 100. The outer ones show "
+                "the tail behaviour, but need a large sample size to mean much."
+                "\n\n"
+                "Leave this empty to report none.");
+        if (!percentiles_text_valid) {
+            TextIconGhost(); ImGui::SameLine(icon_width);
+            ImGui::Text("Invalid list (at most %u percentiles); using the last valid one.",
+                        PROFILER_PERCENTILES_MAX);
+        }
         ImGui::PopItemWidth();
 
         ImGui::Separator();
@@ -785,14 +1168,193 @@ void show_profiler_windows(
                 "computation in its branch predictor. If you experience this problem, increase "
                 "the sample size.");
 
+        TextIconGhost(); ImGui::SameLine(icon_width);
+        ImGuiDragU32(
+                "Retire after stable repetitions",
+                &next_run_params.stable_repetitions,
+                1, 0, U32_MAX, "%u",
+                ImGuiSliderFlags_AlwaysClamp);
+        ImGui::SameLine(); HelpMarker(
+                "Adaptive repetitions: Once a test unit has gone this many repetitions in a row "
+                "without a new minimum time, consider its minimum found, and skip it in the "
+                "remaining repetitions. Most units settle within a few repetitions, so this saves "
+                "most of the cost of a high repetition count."
+                "\n\n"
+                "Set this to zero to repeat every unit every time.");
+
         TextIconGhost(); ImGui::SameLine(icon_width);
         ImGui::Text(
-                u8"The target will be invoked %u × %u = %" PRIu64 " times.",
+                u8"The target will be invoked %s%u × %u = %" PRIu64 " times.",
+                (next_run_params.precision_pct > 0.0f || next_run_params.stable_repetitions != 0 ||
+                 next_run_params.refine_points != 0)
+                ? "at most " : "",
                 next_run_params.num_units,
                 next_run_params.repetitions,
                 // NOTE Things like this should be computed not here, but in a lower layer.
                 (u64)next_run_params.num_units * (u64)next_run_params.repetitions);
 
+        TextIcon(ICON_LC_HOURGLASS); ImGui::SameLine(icon_width);
+        ImGuiDragU32(
+                "Unit timeout (ms)",
+                &next_run_params.unit_timeout_ms,
+                10.0f, 0, U32_MAX, "%u",
+                ImGuiSliderFlags_AlwaysClamp);
+        ImGui::SameLine(); HelpMarker(
+                "If a single test unit takes longer than this, don't go on to larger n: finish "
+                "the repetitions for the values of n measured so far, and end the run there. "
+                "This keeps wide sweeps over slow (e.g., quadratic) targets from running for "
+                "hours."
+                "\n\n"
+                "A profiler running in a child process is killed if a unit overruns this by "
+                "much; a profiler running in a thread can only stop after the unit returns."
+                "\n\n"
+                "Set this to zero for no limit.");
+
+        TextIcon(ICON_LC_CALENDAR_CLOCK); ImGui::SameLine(icon_width);
+        ImGuiDragU32(
+                "Run budget (s)",
+                &next_run_params.run_budget_s,
+                1.0f, 0, U32_MAX, "%u",
+                ImGuiSliderFlags_AlwaysClamp);
+        ImGui::SameLine(); HelpMarker(
+                "End the run after this much time, keeping whatever has been measured so far, "
+                "and move on to the next queued run."
+                "\n\n"
+                "Set this to zero for no limit.");
+
+        TextIcon(ICON_LC_LAYERS); ImGui::SameLine(icon_width);
+        ImGuiDragU32(
+                u8"Batch duration (µs)",
+                &next_run_params.batch_target_us,
+                1.0f, 0, 1000000, "%u",
+                ImGuiSliderFlags_AlwaysClamp);
+        ImGui::SameLine(); HelpMarker(
+                "For targets that finish faster than the timer can resolve: Time each test unit "
+                "as a batch of consecutive calls on freshly sampled inputs, lasting at least this "
+                "long, and record the time per call. The number of calls in a batch is "
+                "calibrated separately for each value of n, at the start of the run."
+                "\n\n"
+                "A batch measures the target with its inputs in cache and its branches "
+                "predicted from the previous calls, and the overhead adjustment is spread over "
+                "the whole batch. Only the first input in each batch is verified."
+                "\n\n"
+                "Set this to zero to time one call at a time.");
+
+        #ifndef _WIN32
+        TextIcon(ICON_LC_MEMORY_STICK); ImGui::SameLine(icon_width);
+        if (ImGui::BeginCombo("Huge pages",
+                              huge_pages_kinds[next_run_params.huge_pages].name_long, 0)) {
+            for (u32 i = 0; i < HUGE_PAGES_ID_MAX; i++) {
+                bool is_selected = (next_run_params.huge_pages == (HugePagesID)i);
+                if (ImGui::Selectable(huge_pages_kinds[i].name_long, is_selected)) {
+                    next_run_params.huge_pages = (HugePagesID)i;
+                }
+                if (is_selected) {
+                    ImGui::SetItemDefaultFocus();
+                }
+            }
+            ImGui::EndCombo();
+        }
+        ImGui::SameLine(); HelpMarker(
+                "Back the input, output, and scratch buffers with 2 MiB pages instead of 4 KiB "
+                "ones. For large n, a target that accesses its input all over spends much of its "
+                "time on TLB misses (page walks); comparing runs with and without huge pages "
+                "separates that cost from the algorithm's own."
+                "\n\n"
+                "Transparent: Ask the kernel for transparent huge pages. It may still use small "
+                "pages, e.g., if THP is disabled (see /sys/kernel/mm/transparent_hugepage). A run "
+                "in a separate process keeps its input in shared memory, which only gets "
+                "transparent huge pages if shmem_enabled allows it."
+                "\n\n"
+                "Explicit: Take pages from the reserved pool (see /proc/sys/vm/nr_hugepages), "
+                "falling back to transparent huge pages if the pool is too small."
+                "\n\n"
+                "The run's details show which kind of pages the buffers actually got.");
+        #endif
+
+        #ifndef _WIN32
+        TextIconGhost(); ImGui::SameLine(icon_width);
+        if (ImGui::BeginCombo("NUMA placement",
+                              numa_placements[next_run_params.numa_placement].name_long, 0)) {
+            for (u32 i = 0; i < NUMA_PLACEMENT_ID_MAX; i++) {
+                bool is_selected = (next_run_params.numa_placement == (NumaPlacementID)i);
+                if (ImGui::Selectable(numa_placements[i].name_long, is_selected)) {
+                    next_run_params.numa_placement = (NumaPlacementID)i;
+                }
+                if (is_selected) {
+                    ImGui::SetItemDefaultFocus();
+                }
+            }
+            ImGui::EndCombo();
+        }
+        ImGui::SameLine(); HelpMarker(
+                "Which NUMA node the input, output, results, and scratch space are placed on."
+                "\n\n"
+                "Any: Let the kernel decide, which usually means the node of the worker, since "
+                "it touches the memory first."
+                "\n\n"
+                "Local: Bind the memory to the worker's node."
+                "\n\n"
+                "Remote: Bind the memory to another node (the next one after the worker's), to "
+                "measure what remote memory costs the target. This needs a machine with more "
+                "than one node."
+                "\n\n"
+                "The run's details show the nodes that the worker and the input ended up on.");
+        #endif
+
+        TextIconGhost(); ImGui::SameLine(icon_width);
+        ImGui::Checkbox("Lock memory", &next_run_params.lock_memory);
+        ImGui::SameLine(); HelpMarker(
+                "Before the warmup, the profiler always touches every page of memory that the "
+                "measurements will use (the input, output, results, and scratch space), so that "
+                "no page faults land inside a measurement. With this option, it also locks that "
+                "memory into RAM for the rest of the run, so that it can't be swapped out under "
+                "memory pressure."
+                "\n\n"
+                "Locking may fail for large runs if the limit on locked memory is low (see "
+                "`ulimit -l`); the run's details say whether it succeeded.");
+
+        TextIconGhost(); ImGui::SameLine(icon_width);
+        if (ImGui::BeginCombo("Cache state",
+                              cache_states[next_run_params.cache_state].name_long, 0)) {
+            for (u32 i = 0; i < CACHE_STATE_ID_MAX; i++) {
+                bool is_selected = (next_run_params.cache_state == (CacheStateID)i);
+                if (ImGui::Selectable(cache_states[i].name_long, is_selected)) {
+                    next_run_params.cache_state = (CacheStateID)i;
+                }
+                if (is_selected) {
+                    ImGui::SetItemDefaultFocus();
+                }
+            }
+            ImGui::EndCombo();
+        }
+        ImGui::SameLine(); HelpMarker(
+                "Where the input and scratch space are in the cache hierarchy when the target "
+                "is called. A target that's called over and over from a loop sees hot caches, "
+                "but one that's called once in a while from a larger program usually doesn't."
+                "\n\n"
+                "Hot: Leave them where the sampler left them, in the nearest caches they fit in."
+                "\n\n"
+                "Last-level cache only: Read through a buffer twice the size of L2 just before "
+                "each measurement, to push them out of L1 and L2."
+                "\n\n"
+                "Cold: Flush them from every cache (with CLFLUSH) just before each measurement, "
+                "so the target reads them from memory."
+                "\n\n"
+                "With batching, only the first call in each batch sees its scratch space cold; "
+                "turn batching off for fully cold measurements.");
+
+        TextIconGhost(); ImGui::SameLine(icon_width);
+        ImGui::Checkbox("Track memory", &next_run_params.track_memory);
+        ImGui::SameLine(); HelpMarker(
+                "Record how much scratch space and stack the target uses for each unit, and plot "
+                "the peaks against n in the Memory window."
+                "\n\n"
+                "The memory is measured in an extra, untimed call of the target on the same "
+                "input, with its scratch space and the stack filled with a known pattern "
+                "beforehand; whatever has been overwritten afterwards was used. The stack is "
+                "watched only to a depth of 256 KiB.");
+
         ImGui::PopItemWidth();
         ImGui::Separator();
 
@@ -801,6 +1363,44 @@ void show_profiler_windows(
         ImGui::SameLine(); HelpMarker(
                 "Disabling this option will make the results more repeatable, but the GUI will "
                 "stop responding until the profiler is finished.");
+
+        #ifndef _WIN32
+        TextIconGhost(); ImGui::SameLine(icon_width);
+        ImGui::BeginDisabled(!next_run_params.separate_thread);
+        ImGui::Checkbox("Run in child process", &next_run_params.separate_process);
+        ImGui::EndDisabled();
+        ImGui::SameLine(); HelpMarker(
+                "Run the profiler in its own process rather than a thread of the GUI's. A target "
+                "that crashes or hangs can then be killed without taking down the GUI, and the "
+                "profiler's memory isn't interleaved with the GUI's.");
+        #endif
+
+        TextIconGhost(); ImGui::SameLine(icon_width);
+        ImGui::BeginDisabled(!next_run_params.separate_thread);
+        ImGui::Checkbox("Run alone", &next_run_params.run_alone);
+        ImGui::EndDisabled();
+        ImGui::SameLine(); HelpMarker(
+                "Wait until all other profiler workers have finished before starting this run, "
+                "and don't start any others until it's done. Use this when the run needs a quiet "
+                "machine (e.g., memory-bound targets, which compete for shared cache and memory "
+                "bandwidth).");
+
+        TextIcon(ICON_LC_CPU); ImGui::SameLine(icon_width);
+        u32 workers_max = MIN(PROFILER_WORKERS_MAX, MAX(1, host->cpu_num_physical_cores));
+        ImGui::PushItemWidth(ImGui::GetFontSize() * 3);
+        ImGuiDragU32(
+                "Worker threads",
+                &guiconf->profiler_workers,
+                0.1f, 1, workers_max, "%u",
+                ImGuiSliderFlags_AlwaysClamp);
+        ImGui::PopItemWidth();
+        ImGui::SameLine(); HelpMarker(
+                "The number of queued runs that may execute concurrently, each in its own thread "
+                "(or process) pinned to its own physical core. This applies to all queued runs, not just the "
+                "next one."
+                "\n\n"
+                "Concurrent runs share the memory bus and the last-level cache, so their timings "
+                "may be noisier than if they had been run one at a time.");
         ImGui::Separator();
 
         TextIcon(ICON_LC_TIMER); ImGui::SameLine(icon_width);
@@ -820,9 +1420,15 @@ void show_profiler_windows(
                 "_sum_ of timings of all threads in the current process, including those unrelated "
                 "to the profiler target, so its output data will be higher. These two methods "
                 "may fail to convert to accurate wall time. "
+                "\n\n"
+                "The counters (Linux only) don't measure time at all, but count hardware events "
+                "such as cache misses while the target runs. They show why a target is slow, "
+                "rather than just how slow it is. Only events in user mode are counted. If no "
+                "counters are listed, the kernel may not allow them: see "
+                "/proc/sys/kernel/perf_event_paranoid."
             );
         for (u32 i = 0; i < TIMING_METHOD_ID_MAX; ++i) {
-            if (timing_methods[i].available[host->os]) {
+            if (timing_method_available((TimingMethodID)i, host)) {
                 TextIconGhost(); ImGui::SameLine(icon_width);
                 if (ImGui::RadioButton(timing_methods[i].name_long,
                                        next_run_params.timing == (TimingMethodID)i)) {
@@ -836,6 +1442,19 @@ void show_profiler_windows(
                 "Try to measure, and compensate for, the time required to execute the timing "
                 "instructions.\n\n"
                 "This is unreliable for certain systems and/or timing methods.");
+        #ifndef _WIN32
+        TextIconGhost(); ImGui::SameLine(icon_width);
+        ImGui::Checkbox("Re-measure disturbed units", &next_run_params.reject_disturbed);
+        ImGui::SameLine(); HelpMarker(
+                "Count the context switches and page faults that happen while the target runs, "
+                "and measure the unit again (with the same input) if there were any. This "
+                "discards the samples that were pre-empted by the operating system, which is "
+                "what repetitions are mostly for, so fewer repetitions may be needed."
+                "\n\n"
+                "Reading the counts costs two system calls per unit, outside of the timed "
+                "region. A unit that is disturbed every time (e.g., because it takes longer than "
+                "a scheduler time slice) is kept after a few tries.");
+        #endif
 
         ImGui::Separator();
 
@@ -893,6 +1512,22 @@ void show_profiler_windows(
                         "not necessarily coincide with the actual granularity of this timer.");
             }
 
+            if (timing_methods[TIMING_PERF_CYCLES].available[host->os]) {
+                u32 num_perf_events = 0;
+                for (u32 i = 0; i < PERF_EVENT_ID_MAX; ++i) {
+                    num_perf_events += host->has_perf_event[i];
+                }
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0); ImGui::Text("Counters:");
+                ImGui::TableSetColumnIndex(1);
+                ImGui::Text("%u of %u", num_perf_events, PERF_EVENT_ID_MAX - 1);
+                ImGui::TableSetColumnIndex(3); HelpMarker(
+                        "The number of hardware performance counters that perf_event_open() "
+                        "lets us use. They are read directly with RDPMC where the kernel allows "
+                        "it, and otherwise through a (much slower) system call; in that case, "
+                        "consider \"Adjust for timer overhead\".");
+            }
+
             ImGui::EndTable();
         }
     }
@@ -929,6 +1564,21 @@ void show_profiler_windows(
                     "The number of logical processors available to the operating system. "
                     "This may differ from the number of physical cores.");
 
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0); ImGui::Text("Physical cores:");
+            ImGui::TableSetColumnIndex(1); ImGui::Text("%u", host->cpu_num_physical_cores);
+            ImGui::SameLine(); HelpMarker(
+                    "Logical processors that share a core (via SMT/Hyper-Threading) are counted "
+                    "once. This is the maximum number of profiler worker threads.");
+
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0); ImGui::Text("NUMA nodes:");
+            ImGui::TableSetColumnIndex(1); ImGui::Text("%u", host->numa_num_nodes);
+            ImGui::SameLine(); HelpMarker(
+                    "On a multi-socket machine, each socket (or part of one) has its own memory, "
+                    "and memory on another node takes longer to reach. Workers are pinned to "
+                    "cores, and hence to nodes; see the NUMA placement option.");
+
             ImGui::TableNextRow();
             ImGui::TableSetColumnIndex(0); ImGui::Text("Has TSC:");
             ImGui::TableSetColumnIndex(1); ImGui::Text("%s", host->has_tsc ? "Yes" : "No");
@@ -937,6 +1587,15 @@ void show_profiler_windows(
                     "register that serves to provide highly precise timing information. In early "
                     "CPUs, it was incremented on each clock cycle.");
 
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0); ImGui::Text("Has RDTSCP:");
+            ImGui::TableSetColumnIndex(1); ImGui::Text("%s", host->has_rdtscp ? "Yes" : "No");
+            ImGui::SameLine(); HelpMarker(
+                    "RDTSCP reads the TSC only after all preceding instructions have completed. "
+                    "The profiler uses it to end each measurement, so that the target can't "
+                    "still be running when the clock stops. Without it, the profiler uses "
+                    "RDTSC behind a fence, which costs a little more.");
+
             ImGui::TableNextRow();
             ImGui::TableSetColumnIndex(0); ImGui::Text("Invariant TSC:");
             ImGui::TableSetColumnIndex(1); ImGui::Text("%s", host->has_invariant_tsc ? "Yes" : "No");
@@ -971,6 +1630,16 @@ void show_profiler_windows(
                 run->state = PROFRUN_PENDING;
                 run->sync = {0};
                 run->thread_handle = 0;
+                run->process_handle = 0;
+                run->worker_crashed = false;
+                run->start_ms = 0;
+                run->watchdog_progress = 0;
+                run->watchdog_ms = 0;
+                run->watchdog_fired = false;
+                run->timed_out = false;
+                run->fit = {0};
+                run->worker_idx = 0;
+                run->worker_cpu_id = 0;
                 run->params = next_run_params;
                 run->result = result_tmp;
                 run->intent_visible = true;
@@ -1089,7 +1758,8 @@ void show_profiler_windows(
                 // deleted and/or reordered, and we want the GUI status (e.g., which treenodes
                 // are open) to persist.
                 ImGui::PushID((i32)(runs->data[i].id));
-                char const* result_name = targets[p->target_idx].name;
+                char result_name[128];
+                profrun_name(p, result_name, sizeof(result_name));
                 ImGui::TableNextRow();
 
                 ImGui::TableSetColumnIndex(0);
@@ -1110,7 +1780,7 @@ void show_profiler_windows(
                 } break;
                 case PROFRUN_DONE_SUCCESS: {
                     if (!(p->verifier_enabled) ||
-                        *(result->verification_accept_count) == p->num_units) {
+                        *(result->verification_accept_count) == *(result->units_published)) {
                         cell_bg_color = (ImU32)ImGuiCol_Header;
                     } else {
                         // Verifier failed to accept all units.
@@ -1133,27 +1803,52 @@ void show_profiler_windows(
                         ImGuiTreeNodeFlags_SpanAvailWidth |
                         ImGuiTreeNodeFlags_AllowOverlap);
                 if (profrun_busy(run)) {
-                    // Show progress. NOTE This is a memory-unsafe read (may be torn), but we'll
-                    // leve it as is because the multithreading is going to be torn out anyway (to
-                    // be replaced by multiple processes).
+                    // Show progress (published atomically by the profiler).
                     ImGui::SameLine();
                     // Default color for progress bar is ugly orange.
                     ImGui::PushStyleColor(ImGuiCol_PlotHistogram, (ImU32)0x8000FF00);
-                    ImGui::ProgressBar(*(result->progress), ImVec2(-1.0f, 0.0f));
+                    ImGui::ProgressBar(profiler_result_progress(*result), ImVec2(-1.0f, 0.0f));
                     ImGui::PopStyleColor();
                 }
 
                 if (tree_node_open) {
                     if (ImGui::Button(ICON_LC_COPY " Again")) {
                         next_run_params = *p;
+                        percentiles_text_stale = true;
                     }
                     ImGui::SameLine();
                     HelpMarker("Re-load these parameters to use for the next run.");
                     ImGui::Text("Sampler: %s", samplers[p->sampler_idx].name);
-                    ImGui::Text("Range: (%u, %u, %u)", p->ns.lower, p->ns.stride, p->ns.upper);
+                    if (p->ns_kind == RANGE_GEOMETRIC) {
+                        ImGui::Text("Range: %u to %u, %u per decade",
+                                    p->ns_geom.lower, p->ns_geom.upper, p->ns_geom.per_decade);
+                    } else if (p->ns_kind == RANGE_CACHES) {
+                        ImGui::Text("Range: Around caches of %u, %u, %u KiB; %u per cache",
+                                    p->ns_caches.cache_sizes[0] >> 10,
+                                    p->ns_caches.cache_sizes[1] >> 10,
+                                    p->ns_caches.cache_sizes[2] >> 10,
+                                    p->ns_caches.per_cache);
+                    } else {
+                        ImGui::Text("Range: (%u, %u, %u)",
+                                    p->ns.lower, p->ns.stride, p->ns.upper);
+                    }
+                    if (p->refine_points != 0) {
+                        ImGui::Text("Refinement: Up to %u more values of n",
+                                    p->refine_points);
+                    }
 
-                    ImGui::Text("Sample size: %u", p->sample_size);
-                    ImGui::Text("Total units: %u", p->num_units);
+                    if (p->precision_pct > 0.0f) {
+                        ImGui::Text(u8"Sample size: %u to %u (adaptive, %s ±%.1f%%)",
+                                    MIN(MAX(p->sample_size_min, 2u), p->sample_size),
+                                    p->sample_size,
+                                    p->precision_of_median ? "median" : "mean",
+                                    p->precision_pct);
+                    } else {
+                        ImGui::Text("Sample size: %u", p->sample_size);
+                    }
+                    ImGui::Text("Total units: %u", profrun_done(run)
+                                ? *(result->units_published)
+                                : p->num_units);
                     ImGui::Text("Seed: %" PRIu64, p->seed);
                     /*  // Copy to clipboard -- works, but is very ugly.
                     ImGui::SameLine();
@@ -1166,11 +1861,79 @@ void show_profiler_windows(
                     }
                     */
                     ImGui::Text("Timing: %s", timing_methods[p->timing].name_short);
-                    ImGui::Text("Repetitions: %u", p->repetitions);
+                    if (p->stable_repetitions != 0) {
+                        ImGui::Text("Repetitions: %u (retiring units after %u stable)",
+                                    p->repetitions, p->stable_repetitions);
+                    } else {
+                        ImGui::Text("Repetitions: %u", p->repetitions);
+                    }
+                    if (p->batch_target_us != 0) {
+                        if (profrun_done(run) && *(result->groups_valid) > 0) {
+                            u32 batch_min = U32_MAX;
+                            u32 batch_max = 0;
+                            for (u32 i = 0; i < *(result->groups_valid); ++i) {
+                                batch_min = MIN(batch_min, result->groups[i].batch_size);
+                                batch_max = MAX(batch_max, result->groups[i].batch_size);
+                            }
+                            ImGui::Text(u8"Batching: %u µs (%u to %u calls)",
+                                        p->batch_target_us, batch_min, batch_max);
+                        } else {
+                            ImGui::Text(u8"Batching: %u µs", p->batch_target_us);
+                        }
+                    }
+                    if (run->fit.valid) {
+                        char fit_description[128];
+                        complexity_fit_describe(run->fit, fit_description, sizeof(fit_description));
+                        ImGui::Text("Complexity: %s", fit_description);
+                    }
+                    if (p->reject_disturbed) {
+                        ImGui::Text("Re-measured: %u disturbed measurements",
+                                    *(result->remeasurements));
+                    }
+                    if (p->huge_pages != HUGE_PAGES_NONE && profrun_done(run)) {
+                        ImGui::Text("Huge pages: %s (requested: %s)",
+                                    huge_pages_kinds[*(result->huge_pages)].name_long,
+                                    huge_pages_kinds[p->huge_pages].name_long);
+                    }
+                    if (p->track_memory && *(result->groups_valid) > 0) {
+                        ProfilerResultGroup* last = &result->groups[*(result->groups_valid) - 1];
+                        ImGui::Text("Peak memory at n = %.0f: %.0f B scratch, %.0f B stack",
+                                    last->n, last->scratch_peak, last->stack_peak);
+                    }
+                    if ((host->numa_num_nodes > 1 || p->numa_placement != NUMA_ANY) &&
+                        profrun_done(run)) {
+                        ImGui::Text("NUMA: Worker on node %d, input on node %d (placement: %s)",
+                                    *(result->numa_node_worker),
+                                    *(result->numa_node_memory),
+                                    numa_placements[p->numa_placement].name_long);
+                    }
+                    if (p->cache_state != CACHE_HOT) {
+                        ImGui::Text("Cache state: %s", cache_states[p->cache_state].name_long);
+                    }
+                    if (p->lock_memory && profrun_done(run)) {
+                        ImGui::Text("Memory: %s", *(result->memory_locked)
+                                    ? "Locked"
+                                    : "Not locked (over the limit on locked memory?)");
+                    }
+                    if (run->timed_out) {
+                        ImGui::Text("Timed out: Measured %u of %u values of n",
+                                    *(result->groups_valid), p->num_groups);
+                    }
+                    if (!p->separate_thread) {
+                        ImGui::Text("Worker: GUI thread");
+                    } else if (run->state == PROFRUN_PENDING) {
+                        ImGui::Text("Worker: Pending%s", p->run_alone ? " (alone)" : "");
+                    } else {
+                        ImGui::Text("Worker: Processor %u%s%s",
+                                    run->worker_cpu_id,
+                                    profiler_params_in_process(*p) ? " (process)" : "",
+                                    p->run_alone ? " (alone)" : "");
+                    }
                     ImGui::Text("Verification: %s",
                                 p->verifier_enabled
                                 ? (profrun_done(run)  // Avoid race condition.
-                                   ? (p->num_units == *(result->verification_accept_count)
+                                   ? (*(result->units_published) ==
+                                      *(result->verification_accept_count)
                                       ? ICON_LC_CHECK " Success"
                                       : ICON_LC_X " Failure")
                                    : "Pending")
@@ -1209,22 +1972,46 @@ void show_profiler_windows(
             guiconf->visible_data_individual ||
             guiconf->visible_data_mean ||
             guiconf->visible_data_median ||
-            guiconf->visible_data_bounds;
+            guiconf->visible_data_bounds ||
+            guiconf->visible_data_ci ||
+            guiconf->visible_data_percentiles ||
+            guiconf->visible_data_fit;
         ImGui::Checkbox("Display individual test units", &guiconf->visible_data_individual);
         ImGui::Checkbox("Display bounds", &guiconf->visible_data_bounds);
         ImGui::Checkbox("Display median", &guiconf->visible_data_median);
         ImGui::Checkbox("Display mean", &guiconf->visible_data_mean);
+        ImGui::Checkbox("Display confidence intervals", &guiconf->visible_data_ci);
+        ImGui::SameLine();
+        HelpMarker("Error bars around the mean, covering its 95% confidence interval (by "
+                   "Student's t-distribution). With repetitions, the interval is for the mean of "
+                   "each unit's best time.");
+        ImGui::Checkbox("Display percentiles", &guiconf->visible_data_percentiles);
+        ImGui::SameLine();
+        HelpMarker("Thin lines at the percentiles of each value of n that were chosen for the "
+                   "run (by default, the 1st, 5th, 25th, 75th, 95th, and 99th). The outer "
+                   "percentiles show the tail behaviour, but need a large sample size to mean "
+                   "much.");
+        ImGui::Checkbox("Display fitted complexity", &guiconf->visible_data_fit);
+        ImGui::SameLine();
+        HelpMarker("A thin curve for the growth model that best fits the median, chosen from "
+                   "O(1), O(log n), O(n), O(n log n), O(n²), O(n³), and power laws by least "
+                   "squares. The model and its coefficients are shown in each run's details. "
+                   "The curve appears once the run is complete.");
         ImGui::Checkbox("Auto-zoom", &guiconf->auto_zoom);
         ImGui::Checkbox("Live view", &guiconf->live_view);
         ImGui::SameLine();
-        HelpMarker("Watch the results as they come in. This may decrease performance, and is "
-                   "not memory safe.\n\nNot recommended.");
+        HelpMarker("Watch the results as they come in. The profiler never waits for the GUI, but "
+                   "redrawing many points on every frame takes CPU time and memory bandwidth "
+                   "away from the profiler, which may disturb its measurements.");
 
         bool visible_any_now =
             guiconf->visible_data_individual ||
             guiconf->visible_data_mean ||
             guiconf->visible_data_median ||
-            guiconf->visible_data_bounds;
+            guiconf->visible_data_bounds ||
+            guiconf->visible_data_ci ||
+            guiconf->visible_data_percentiles ||
+            guiconf->visible_data_fit;
         if (!visible_any_prev && visible_any_now && guiconf->auto_zoom) {
             // Bugfix: If user made new data while nothing was visible, we must re-adjust axes.
             for (usize i = 0; i < runs->len; ++i) {
@@ -1266,7 +2053,22 @@ void show_profiler_windows(
                 /* | ImPlotFlags_Crosshairs */  // Crosshairs are laggy on Linux/Wine.
             )) {
 
-        char const* time_axis_label = "Time (ns)";
+        // Label the axis with whatever the visible runs measured (usually time).
+        char const* time_axis_label = timing_methods[TIMING_RDTSC].metric_label;
+        bool first_visible = true;
+        for (usize i = 0; i < runs->len; ++i) {
+            Profrun* run = &(runs->data[i]);
+            if (!profrun_actually_visible(run, guiconf->live_view)) {
+                continue;
+            }
+            char const* label = timing_methods[run->params.timing].metric_label;
+            if (first_visible) {
+                time_axis_label = label;
+                first_visible = false;
+            } else if (strcmp(label, time_axis_label) != 0) {
+                time_axis_label = "(Mixed metrics)";
+            }
+        }
         ImPlot::SetupAxes("n", time_axis_label, 0, 0);
         ImPlot::SetupLegend(ImPlotLocation_NorthWest, ImPlotLegendFlags_NoButtons);
 
@@ -1275,51 +2077,123 @@ void show_profiler_windows(
             ProfilerParams* params = &run->params;
             ProfilerResult* result = &run->result;
             if (!profrun_actually_visible(run, guiconf->live_view)) {
-                // If we keep going here, the user will see a "live" view of the results as
-                // the profiler thread writes them; however, this is not memory-safe.
                 continue;
             }
 
-            char const* plot_name = targets[params->target_idx].name;
+            char plot_name[128];
+            profrun_name(params, plot_name, sizeof(plot_name));
+
+            // Plot only what the profiler has published: a run that timed out has fewer units and
+            // groups than requested. While the profiler is still running ("live view"), take a
+            // consistent snapshot of the groups, as they may change under us.
+            ProfilerResultGroup* groups = result->groups;
+            u32 num_groups = atomic_load_u32(result->groups_valid);
+            u32 num_units = atomic_load_u32(result->units_published);
+            ArenaTmp scratch = scratch_get(NULL, 0);
+            if (!profrun_done(run)) {
+                usize groups_size = params->num_groups * sizeof(*groups);
+                groups = NULL;
+                if (scratch.a->len - scratch.a->pos >= groups_size) {
+                    ProfilerResultGroup* snapshot =
+                        (ProfilerResultGroup*)arena_push(scratch.a, groups_size);
+                    if (profiler_result_read_groups(*params, *result, snapshot)) {
+                        groups = snapshot;
+                    }
+                }
+                if (!groups) {
+                    num_groups = 0;
+                }
+            }
 
-            if (guiconf->visible_data_bounds) {
+            if (guiconf->visible_data_bounds && num_groups > 0) {
                 ImPlot::PushStyleVar(ImPlotStyleVar_FillAlpha, 0.25f);
                 ImPlot::PlotShaded(
                         plot_name,
-                        &result->groups[0].n,
-                        &result->groups[0].time_min,
-                        &result->groups[0].time_max,
+                        &groups[0].n,
+                        &groups[0].time_min,
+                        &groups[0].time_max,
                         // NOTE ImPlot requires i32; this is possibly a bug for us, but
                         // we won't be using ImPlot forever so we won't bother fixing this.
-                        (i32)params->num_groups,
+                        (i32)num_groups,
                         0,
                         0,
-                        sizeof(*result->groups));
+                        sizeof(*groups));
                 ImPlot::PopStyleVar();
             }
 
-            if (guiconf->visible_data_median) {
+            if (guiconf->visible_data_median && num_groups > 0) {
                 ImPlot::SetNextLineStyle(IMPLOT_AUTO_COL, 2.0f);
                 ImPlot::PlotLine(
                         plot_name,
-                        &result->groups[0].n,
-                        &result->groups[0].time_median,
-                        (i32)params->num_groups,
+                        &groups[0].n,
+                        &groups[0].time_median,
+                        (i32)num_groups,
                         0,
                         0,
-                        sizeof(*result->groups));
+                        sizeof(*groups));
             }
 
-            if (guiconf->visible_data_mean) {
+            if (guiconf->visible_data_mean && num_groups > 0) {
                 ImPlot::SetNextLineStyle(IMPLOT_AUTO_COL, 2.0f);
                 ImPlot::PlotLine(
                         plot_name,
-                        &result->groups[0].n,
-                        &result->groups[0].time_mean,
-                        (i32)params->num_groups,
+                        &groups[0].n,
+                        &groups[0].time_mean,
+                        (i32)num_groups,
                         0,
                         0,
-                        sizeof(*result->groups));
+                        sizeof(*groups));
+            }
+
+            if (guiconf->visible_data_percentiles && num_groups > 0) {
+                for (u32 p = 0; p < params->percentiles_count; ++p) {
+                    ImPlot::SetNextLineStyle(IMPLOT_AUTO_COL, 1.0f);
+                    ImPlot::PlotLine(
+                            plot_name,
+                            &groups[0].n,
+                            &groups[0].time_percentiles[p],
+                            (i32)num_groups,
+                            0,
+                            0,
+                            sizeof(*groups));
+                }
+            }
+
+            if (guiconf->visible_data_fit && profrun_done(run) && run->fit.valid &&
+                num_groups > 0) {
+                // Sample the curve finely, so that it's smooth whatever the stride of n. Space the
+                // points the way the values of n are spaced, so that they're even on the plot
+                // when n is on a log scale.
+                #define FIT_CURVE_POINTS 128
+                if (scratch.a->len - scratch.a->pos >= 2 * FIT_CURVE_POINTS * sizeof(f64)) {
+                    f64* xs = arena_push_array(scratch.a, f64, FIT_CURVE_POINTS);
+                    f64* ys = arena_push_array(scratch.a, f64, FIT_CURVE_POINTS);
+                    f64 n_first = groups[0].n;
+                    f64 n_last = groups[num_groups - 1].n;
+                    bool geometric = params->ns_kind != RANGE_ARITHMETIC && n_first > 0.0;
+                    for (u32 j = 0; j < FIT_CURVE_POINTS; ++j) {
+                        f64 t = (f64)j / (FIT_CURVE_POINTS - 1);
+                        xs[j] = geometric
+                            ? n_first * pow(n_last / n_first, t)
+                            : n_first + (n_last - n_first) * t;
+                        ys[j] = complexity_evaluate(run->fit, xs[j]);
+                    }
+                    ImPlot::SetNextLineStyle(IMPLOT_AUTO_COL, 1.5f);
+                    ImPlot::PlotLine(plot_name, xs, ys, FIT_CURVE_POINTS);
+                }
+                #undef FIT_CURVE_POINTS
+            }
+
+            if (guiconf->visible_data_ci && num_groups > 0) {
+                ImPlot::PlotErrorBars(
+                        plot_name,
+                        &groups[0].n,
+                        &groups[0].time_mean,
+                        &groups[0].time_ci95,
+                        (i32)num_groups,
+                        0,
+                        0,
+                        sizeof(*groups));
             }
 
             if (guiconf->visible_data_individual ||
@@ -1338,20 +2212,73 @@ void show_profiler_windows(
                         IMPLOT_AUTO_COL, IMPLOT_AUTO, IMPLOT_AUTO_COL);
                 ImPlot::PlotScatter(
                         plot_name,
-                        &result->units[0].n,
-                        &result->units[0].time,
-                        (i32)params->num_units,
-                        0,
-                        0,
-                        sizeof(*result->units)
+                        result->units.n,
+                        result->units.time,
+                        (i32)num_units
                     );
             }
+            scratch_release(scratch);
         }  // for (result ...)
         ImPlot::EndPlot();
     }
     ImGui::EndChild();
 
     ImGui::End();   // Window: Profiler Plot
+
+
+    ImGui::Begin("Memory");
+
+    if (ImPlot::BeginPlot(
+                "Memory",
+                ImVec2(-1, -1),
+                ImPlotFlags_NoTitle |
+                ImPlotFlags_NoMenus |
+                ImPlotFlags_NoBoxSelect)) {
+        ImPlot::SetupAxes("n", "Peak bytes", 0, ImPlotAxisFlags_AutoFit);
+        ImPlot::SetupLegend(ImPlotLocation_NorthWest, ImPlotLegendFlags_NoButtons);
+
+        for (usize i = 0; i < runs->len; ++i) {
+            Profrun* run = &(runs->data[i]);
+            ProfilerParams* params = &run->params;
+            ProfilerResult* result = &run->result;
+            // Only finished runs: the groups of a run in progress may change under us.
+            if (!params->track_memory || !profrun_done(run) ||
+                !profrun_actually_visible(run, guiconf->live_view)) {
+                continue;
+            }
+            u32 num_groups = *(result->groups_valid);
+            if (num_groups == 0) {
+                continue;
+            }
+
+            char plot_name[128];
+            char line_name[160];
+            profrun_name(params, plot_name, sizeof(plot_name));
+            snprintf(line_name, sizeof(line_name), "%s: scratch", plot_name);
+            ImPlot::SetNextLineStyle(IMPLOT_AUTO_COL, 2.0f);
+            ImPlot::PlotLine(
+                    line_name,
+                    &result->groups[0].n,
+                    &result->groups[0].scratch_peak,
+                    (i32)num_groups,
+                    0,
+                    0,
+                    sizeof(*result->groups));
+            snprintf(line_name, sizeof(line_name), "%s: stack", plot_name);
+            ImPlot::SetNextLineStyle(IMPLOT_AUTO_COL, 2.0f);
+            ImPlot::PlotLine(
+                    line_name,
+                    &result->groups[0].n,
+                    &result->groups[0].stack_peak,
+                    (i32)num_groups,
+                    0,
+                    0,
+                    sizeof(*result->groups));
+        }
+        ImPlot::EndPlot();
+    }
+
+    ImGui::End();  // Window: Memory
 }
 
 int main(int, char**)
@@ -1469,9 +2396,13 @@ int main(int, char**)
     guiconf.visible_data_mean = true;
     guiconf.visible_data_median = false;
     guiconf.visible_data_bounds = true;
+    guiconf.visible_data_ci = false;
+    guiconf.visible_data_percentiles = false;
+    guiconf.visible_data_fit = false;
     guiconf.log_show_timestamps = true;
     guiconf.auto_zoom = true;
     guiconf.live_view = false;
+    guiconf.profiler_workers = 1;
 
     // GUI styling/theme
     GuiStyle guistyle;
@@ -1488,7 +2419,7 @@ int main(int, char**)
 
     // Global state (non-GUI)
     Logger global_log = logger_create();
-    Arena global_arena = arena_create(GLOBAL_ARENA_SIZE);
+    Arena global_arena = arena_create_growable(GLOBAL_ARENA_SIZE);
     HostInfo host = {0};
     darray_profrun profiler_runs = darray_profrun_new(&global_arena, 5);
 
@@ -1639,7 +2570,7 @@ int main(int, char**)
             ImGui::ShowMetricsWindow(&guiconf.visible_imgui_metrics_window);
 
         // Computation
-        manage_profiler_workers(&global_log, &host, &profiler_runs);
+        manage_profiler_workers(&global_log, &host, &profiler_runs, guiconf.profiler_workers);
 
         // Our windows
         show_log_window(&guiconf, &global_log);
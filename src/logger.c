@@ -2,8 +2,9 @@
 #include <stdio.h>
 #include <string.h>
 
-#define LOGGER_CAP 64*1024
-#define LOGGER_MEMORY 8*1024*1024
+// The logger's arenas are growable, so these are only reservations of address space.
+#define LOGGER_CAP 1024*1024
+#define LOGGER_MEMORY 256*1024*1024
 #define LOGGER_MAX_ENTRYSIZE 8192
 
 typedef enum
@@ -54,8 +55,8 @@ Logger logger_create()
     Logger l = {0};
     l.cap = LOGGER_CAP;
     l.len = 0;
-    l.store_entries = arena_create(LOGGER_CAP * sizeof(LoggerEntry));
-    l.store_strs = arena_create(LOGGER_MEMORY);
+    l.store_entries = arena_create_growable(LOGGER_CAP * sizeof(LoggerEntry));
+    l.store_strs = arena_create_growable(LOGGER_MEMORY);
     l.entries = (LoggerEntry*)l.store_entries.data;
     if (!l.store_entries.data || !l.store_strs.data) {
         assertm(false, "Failed to allocate memory for new logger.");
@@ -119,8 +120,8 @@ void logger_destroy(Logger* l)
 void logger_clear(Logger* l)
 {
     l->len = 0;
-    arena_clear(&l->store_entries);
-    arena_clear(&l->store_strs);
+    arena_clear_decommit(&l->store_entries);
+    arena_clear_decommit(&l->store_strs);
 }
 
 // Add a new log entry. Here `message` is a null-terminated UTF-8 string. Messages that are too
@@ -0,0 +1,162 @@
+// Hardware performance counters (Linux only), via perf_event_open(2).
+//
+// Each thread may have one counter open at a time. The counter only counts events in user mode
+// (the default perf_event_paranoid setting forbids more than that), and follows the thread from
+// one CPU to another. Where the kernel allows it, we read the counter from user space with the
+// RDPMC instruction; otherwise, we fall back on the read() syscall, which is much slower.
+//
+// For the details, see the perf_event_open(2) man page, and the comments on struct
+// perf_event_mmap_page in <linux/perf_event.h>.
+
+#ifndef _WIN32
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+typedef enum
+{
+    PERF_EVENT_NONE,  // Not a counter.
+    PERF_EVENT_CYCLES,
+    PERF_EVENT_INSTRUCTIONS,
+    PERF_EVENT_L1D_MISSES,
+    PERF_EVENT_LLC_MISSES,
+    PERF_EVENT_BRANCH_MISSES,
+    PERF_EVENT_ID_MAX
+} PerfEventID;
+
+typedef struct
+{
+    i32 fd;  // -1 if no counter is open.
+    struct perf_event_mmap_page* page;  // For reading with RDPMC; NULL if unavailable.
+} PerfCounter;
+
+static THREAD_LOCAL PerfCounter perf_counter = {-1, NULL};
+
+#ifndef _WIN32
+// Fill in the type and config of the perf_event_attr for the given event.
+static bool perf_event_attr_init(PerfEventID event, struct perf_event_attr* attr)
+{
+    memset(attr, 0, sizeof(*attr));
+    attr->size = sizeof(*attr);
+    attr->type = PERF_TYPE_HARDWARE;
+    switch (event) {
+    case PERF_EVENT_CYCLES: {
+        attr->config = PERF_COUNT_HW_CPU_CYCLES;
+    } break;
+    case PERF_EVENT_INSTRUCTIONS: {
+        attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+    } break;
+    case PERF_EVENT_L1D_MISSES: {
+        attr->type = PERF_TYPE_HW_CACHE;
+        attr->config =
+            PERF_COUNT_HW_CACHE_L1D |
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    } break;
+    case PERF_EVENT_LLC_MISSES: {
+        attr->config = PERF_COUNT_HW_CACHE_MISSES;
+    } break;
+    case PERF_EVENT_BRANCH_MISSES: {
+        attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+    } break;
+    default: {
+        return false;
+    } break;
+    }
+    attr->exclude_kernel = 1;
+    attr->exclude_hv = 1;
+    return true;
+}
+#endif
+
+// Release the calling thread's counter, if it has one open.
+void perf_counter_close()
+{
+  #ifndef _WIN32
+    if (perf_counter.page) {
+        munmap(perf_counter.page, sysconf(_SC_PAGESIZE));
+        perf_counter.page = NULL;
+    }
+    if (perf_counter.fd >= 0) {
+        close(perf_counter.fd);
+    }
+  #endif
+    perf_counter.fd = -1;
+}
+
+// Open a counter for the given event on the calling thread (closing any counter it already had),
+// and start it counting.
+//
+// Return: true on success; false on error (no such event on this CPU, or no permission).
+//
+bool perf_counter_open(PerfEventID event)
+{
+    perf_counter_close();
+  #ifdef _WIN32
+    (void)event;
+    return false;
+  #else
+    struct perf_event_attr attr;
+    if (!perf_event_attr_init(event, &attr)) {
+        return false;
+    }
+    i32 fd = (i32)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0) {
+        return false;
+    }
+    perf_counter.fd = fd;
+    // Mapping the first page is what allows user-space RDPMC, on kernels that support it.
+    void* page = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+    perf_counter.page = (page == MAP_FAILED) ? NULL : (struct perf_event_mmap_page*)page;
+    return true;
+  #endif
+}
+
+// Return true if a counter can be opened for the given event.
+bool perf_counter_probe(PerfEventID event)
+{
+    bool success = perf_counter_open(event);
+    perf_counter_close();
+    return success;
+}
+
+// Return the current value of the calling thread's counter (which must be open). This is inlined
+// into the profiler's measurement kernels.
+static ALWAYS_INLINE u64 perf_counter_read()
+{
+  #ifdef _WIN32
+    return 0;
+  #else
+    struct perf_event_mmap_page volatile* pc = perf_counter.page;
+    if (pc) {
+        // The kernel updates the page when the thread is scheduled in or out; retry if it did so
+        // while we were reading.
+        u64 count = 0;
+        bool in_hardware = false;
+        u32 seq = 0;
+        do {
+            seq = pc->lock;
+            __asm__ __volatile__("" ::: "memory");
+            u32 idx = pc->index;
+            in_hardware = pc->cap_user_rdpmc && idx != 0;
+            if (in_hardware) {
+                u32 width = pc->pmc_width;
+                u64 pmc = __rdpmc((i32)idx - 1);
+                // The hardware counter is only `width` bits wide; sign-extend it.
+                pmc <<= 64 - width;
+                count = (u64)pc->offset + (u64)((i64)pmc >> (64 - width));
+            }
+            __asm__ __volatile__("" ::: "memory");
+        } while (pc->lock != seq);
+        if (in_hardware) {
+            return count;
+        }
+        // Otherwise, RDPMC is disallowed, or the counter isn't currently scheduled on the PMU.
+    }
+    u64 count = 0;
+    if (read(perf_counter.fd, &count, sizeof(count)) != sizeof(count)) {
+        return 0;
+    }
+    return count;
+  #endif
+}
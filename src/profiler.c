@@ -1,3 +1,36 @@
+/**** Constants ****/
+
+// Maximum number of physical cores that we keep track of.
+#define HOST_CORES_MAX 256
+
+// Limits on batching (see ProfilerParams.batch_target_us): the most calls of the target in one
+// timed block, and the most memory for their inputs.
+#define PROFILER_BATCH_SIZE_MAX 65536
+#define PROFILER_BATCH_MEMORY_MAX (16 * 1024 * 1024)
+
+// How many times to re-measure a unit that keeps getting disturbed (see
+// ProfilerParams.reject_disturbed) before keeping the measurement anyway.
+#define PROFILER_DISTURBED_RETRIES_MAX 8
+
+// Memory tracking (see ProfilerParams.track_memory): the value that the target's scratch space and
+// stack are filled with before the call, and how far below the profiler's frame the stack is
+// watched. Deeper stacks are reported as this deep.
+#define PROFILER_MEMORY_PAINT 0xA5
+#define PROFILER_STACK_WATCH_SIZE (256 * 1024)
+
+// The alignment of each of the per-unit arrays (see ProfilerResultUnits): a cache line.
+#define PROFILER_UNITS_ALIGNMENT 64
+
+// The alignment of the result's counters, which the caller touches before the worker starts: a
+// (regular) page, so that they don't share one with the buffers (see profiler_result_create()).
+#define PROFILER_COUNTERS_ALIGNMENT 4096
+
+// The most percentiles of each group that may be reported along with the median (see
+// ProfilerParams.percentiles), and those reported by default.
+#define PROFILER_PERCENTILES_MAX 8
+static f64 const profiler_percentiles_default[] = {1, 5, 25, 75, 95, 99};
+
+
 /**** Types ****/
 
 typedef enum
@@ -14,6 +47,11 @@ typedef enum
     TIMING_QTCT,
     TIMING_QPCT,
     TIMING_CLOCK_GETTIME,
+    TIMING_PERF_CYCLES,
+    TIMING_PERF_INSTRUCTIONS,
+    TIMING_PERF_L1D_MISSES,
+    TIMING_PERF_LLC_MISSES,
+    TIMING_PERF_BRANCH_MISSES,
     TIMING_METHOD_ID_MAX
 } TimingMethodID;
 
@@ -22,16 +60,118 @@ typedef struct
     char const * name_short;
     char const * name_long;
     bool available[OS_ENUM_MAX];
+    // What is measured. Timers are converted to nanoseconds; counters are stored as event counts.
+    bool is_timer;
+    char const * metric_name;   // For file headers, etc.
+    char const * metric_label;  // For plot axes.
+    PerfEventID perf_event;     // PERF_EVENT_NONE unless this is a hardware counter.
 } TimingMethod;
 
+// How the values of n in a run are spaced.
+typedef enum
+{
+    RANGE_ARITHMETIC,  // See ProfilerParams.ns.
+    RANGE_GEOMETRIC,   // See ProfilerParams.ns_geom.
+    RANGE_CACHES,      // See ProfilerParams.ns_caches.
+    RANGE_KIND_ID_MAX
+} RangeKindID;
+
+static char const * range_kind_names[RANGE_KIND_ID_MAX] =
+{
+    "Arithmetic",
+    "Geometric",
+    "Around caches",
+};
+
+// Where the target's input and scratch space are in the cache hierarchy when it's called.
+typedef enum
+{
+    CACHE_HOT,   // Just written by the sampler, so in the nearest caches they fit in.
+    CACHE_LLC,   // Evicted to the last-level cache (by streaming through a buffer twice L2's size).
+    CACHE_COLD,  // Flushed from every cache to memory (with CLFLUSH).
+    CACHE_STATE_ID_MAX
+} CacheStateID;
+
+typedef struct
+{
+    char const * name_short;  // For the command line, and for labels.
+    char const * name_long;
+} CacheState;
+
+static CacheState cache_states[CACHE_STATE_ID_MAX] =
+{
+    { "hot",  "Hot" },
+    { "llc",  "Last-level cache only" },
+    { "cold", "Cold" },
+};
+
+// Which NUMA node the run's memory (input, output, results, and scratch space) is placed on.
+typedef enum
+{
+    NUMA_ANY,     // Wherever the kernel puts it (usually on the node that first touches it).
+    NUMA_LOCAL,   // On the worker's node.
+    NUMA_REMOTE,  // On the node after the worker's (to measure the penalty of remote memory).
+    NUMA_PLACEMENT_ID_MAX
+} NumaPlacementID;
+
+typedef struct
+{
+    char const * name_short;  // For the command line.
+    char const * name_long;
+} NumaPlacement;
+
+static NumaPlacement numa_placements[NUMA_PLACEMENT_ID_MAX] =
+{
+    { "any",    "Any (first touch)" },
+    { "local",  "Local node" },
+    { "remote", "Remote node" },
+};
+
+// Errors that the profiler may encounter while executing a run.
+typedef enum
+{
+    PROFILER_ERROR_NONE,
+    PROFILER_ERROR_SCRATCH_MEMORY,  // Failed to allocate the worker's scratch arenas.
+    PROFILER_ERROR_PERF_COUNTER,    // Failed to open the hardware performance counter.
+    PROFILER_ERROR_CACHE_SIZES,     // The cache state needs cache sizes that weren't detected.
+    PROFILER_ERROR_NUMA_NODE,       // There's no node for the requested NUMA placement.
+    PROFILER_ERROR_NUMA_BIND,       // Failed to bind memory to the NUMA node.
+    PROFILER_ERROR_ID_MAX
+} ProfilerErrorID;
+
+static char const * profiler_error_descriptions[PROFILER_ERROR_ID_MAX] =
+{
+    "No error.",
+    "Failed to allocate scratch memory.",
+    "Failed to open hardware performance counter.",
+    "Cache sizes are unknown, so the input can't be left in the last-level cache.",
+    "No NUMA node to place memory on (the worker's node, or another, has no memory).",
+    "Failed to bind memory to the NUMA node.",
+};
+
 static TimingMethod timing_methods[TIMING_METHOD_ID_MAX] =
 {
     // Do not re-order or delete methods (to avoid corrupting savefiles).
-    { "RDTSC", "X86 Time Stamp Counter (RDTSC)", {true, true} },
-    { "QPC", "Win32 QueryPerformanceCounter (QPC)", {false, true} },
-    { "QTCT", "Win32 QueryThreadCycleTime (QTCT)", {false, true} },
-    { "QPCT", "Win32 QueryProcessCycleTime (QPCT)", {false, true} },
-    { "CLOCK_GETTIME", "POSIX clock_gettime()", {true, false} },
+    { "RDTSC", "X86 Time Stamp Counter (RDTSC)", {true, true},
+      true, "time", "Time (ns)", PERF_EVENT_NONE },
+    { "QPC", "Win32 QueryPerformanceCounter (QPC)", {false, true},
+      true, "time", "Time (ns)", PERF_EVENT_NONE },
+    { "QTCT", "Win32 QueryThreadCycleTime (QTCT)", {false, true},
+      true, "time", "Time (ns)", PERF_EVENT_NONE },
+    { "QPCT", "Win32 QueryProcessCycleTime (QPCT)", {false, true},
+      true, "time", "Time (ns)", PERF_EVENT_NONE },
+    { "CLOCK_GETTIME", "POSIX clock_gettime()", {true, false},
+      true, "time", "Time (ns)", PERF_EVENT_NONE },
+    { "CYCLES", "Counter: CPU cycles (perf)", {true, false},
+      false, "cycles", "CPU cycles", PERF_EVENT_CYCLES },
+    { "INSTRUCTIONS", "Counter: Instructions retired (perf)", {true, false},
+      false, "instructions", "Instructions retired", PERF_EVENT_INSTRUCTIONS },
+    { "L1D_MISSES", "Counter: L1 data cache read misses (perf)", {true, false},
+      false, "l1d_misses", "L1D read misses", PERF_EVENT_L1D_MISSES },
+    { "LLC_MISSES", "Counter: Last-level cache misses (perf)", {true, false},
+      false, "llc_misses", "LLC misses", PERF_EVENT_LLC_MISSES },
+    { "BRANCH_MISSES", "Counter: Branch mispredictions (perf)", {true, false},
+      false, "branch_misses", "Branch mispredictions", PERF_EVENT_BRANCH_MISSES },
 };
 
 typedef struct
@@ -41,6 +181,11 @@ typedef struct
     HostOS os;
     char cpu_name[48];
     u32 cpu_num_cores;
+    u32 cpu_num_physical_cores;
+    u32 cpu_core_ids[HOST_CORES_MAX];  // One logical processor ID on each physical core.
+    u32 cpu_core_nodes[HOST_CORES_MAX];  // The NUMA node of each of cpu_core_ids.
+    u32 numa_num_nodes;  // 1 if there's no NUMA.
+    u64 numa_memory_nodes;  // Bit k is set if NUMA node k has memory (see get_numa_nodes()).
     u32 cpu_cache_l1;
     u32 cpu_cache_l2;
     u32 cpu_cache_l3;
@@ -48,18 +193,42 @@ typedef struct
     u64 qpc_frequency;
     u64 clock_gettime_period;  // ns
     bool has_tsc;
+    bool has_rdtscp;
     bool has_invariant_tsc;
+    bool has_perf_event[PERF_EVENT_ID_MAX];  // The kernel lets us count this event.
 
     u64 _wall_time_freq;
     u64 _wall_time_initial;
     u64 _tsc_initial;
 } HostInfo;
 
+// A cache sweep: the values of n whose working sets (input and output) straddle the capacity of
+// each of the CPU's data caches, which is where a target's time per element tends to jump. For
+// each cache, `per_cache` values are spaced evenly on a log scale, from half the cache's size to
+// twice it; values shared by neighbouring caches are measured once.
+#define PROFILER_CACHE_SWEEP_PER_CACHE_MAX 32
+typedef struct
+{
+    u32 cache_sizes[3];  // Bytes, for L1, L2, and L3 (see HostInfo); 0 if there's no such cache.
+    u32 per_cache;
+    // The values of n, in increasing order and without repeats. These are computed from the above
+    // by cache_sweep_update(), so that stepping through them is cheap.
+    u32 ns[3 * PROFILER_CACHE_SWEEP_PER_CACHE_MAX];
+    u32 ns_count;
+} ProfilerCacheSweep;
+
 typedef struct
 {
     // Sampler parameters
+    RangeKindID ns_kind;  // Which of the following ranges gives the values of n.
     range_u32 ns;
-    u32 sample_size;
+    range_geom_u32 ns_geom;
+    ProfilerCacheSweep ns_caches;
+    u32 refine_points;  // Grid refinement (0: off): values of n to add; see profiler_refine_grid().
+    u32 sample_size;  // Units for each n; with adaptive sampling, the most units for each n.
+    f32 precision_pct;    // Adaptive sampling (0: off): see profiler_group_converged().
+    u32 sample_size_min;  // Adaptive sampling: the fewest units for each n.
+    bool precision_of_median;  // Adaptive sampling: converge on the median, not the mean.
     u64 seed;
     bool seed_from_time;
 
@@ -69,28 +238,56 @@ typedef struct
     bool verifier_enabled;
     u32 verifier_idx;
     bool separate_thread;
+    bool separate_process;  // Run the separate thread in a child process instead (Linux only).
+    bool run_alone;  // Don't share the machine with other profiler workers.
     u32 warmup_ms;
     //repeat_method repeat;
     u32 repetitions;
+    u32 stable_repetitions;  // Adaptive repetitions (0: off): see profiler_execute().
     TimingMethodID timing;
     bool adjust_for_timer_overhead;
+    bool reject_disturbed;  // Re-measure a unit if a context switch or page fault hit it.
+    u32 unit_timeout_ms;  // Stop expanding n once a unit takes longer than this (0: no limit).
+    u32 run_budget_s;     // Wrap up the run once it has taken longer than this (0: no limit).
+    u32 batch_target_us;  // Time the target in batches lasting at least this long (0: no batching).
+    HugePagesID huge_pages;  // Back the input, output and scratch buffers with huge pages.
+    bool lock_memory;  // Lock the run's memory into RAM (it's always pre-faulted).
+    CacheStateID cache_state;
+    bool track_memory;  // Record each unit's peak scratch and stack usage (in an extra call).
+    NumaPlacementID numa_placement;
+    // Percentiles of each group to report along with the median: in increasing order, and strictly
+    // between 0 and 100 (see profiler_params_parse_percentiles()).
+    f64 percentiles[PROFILER_PERCENTILES_MAX];
+    u32 percentiles_count;
 
     // Computed parameters (invariants):
-    // num_groups == range_count(ns).
+    // num_groups_grid == range_count(ns).
+    u32 num_groups_grid;
+    // num_groups == num_groups_grid + refine_points; with grid refinement, this is an upper bound.
     u32 num_groups;
     // num_units == num_groups * sample_size, or 0 in case of integer overflow.
     u32 num_units;
 }  ProfilerParams;
 
+// The results for each test unit, as a struct of arrays: unit i is n[i], time[i], and so on. Passes
+// over all the units (plotting, statistics, export) mostly want just n and time, and this way they
+// read nothing else. Each array has num_units elements; the optional ones are NULL when unused.
 typedef struct
 {
-    RandState seed;  // (sizeof u64)*4 = 32 bytes
-    f64 n;     // Floating-point for now, to satisfy ImPlot.
-    f64 time;  // nanoseconds
-    // Tracking this so the input may be re-created at user's request.
-} ProfilerResultUnit;
-
-// Summary statistics for a batch of test units.
+    f64* n;     // Floating-point for now, to satisfy ImPlot.
+    f64* time;  // nanoseconds; for counter timing methods, the event count.
+    // With reject_disturbed: what disturbed the measurement that was kept. Nonzero only if the
+    // unit couldn't be measured cleanly in PROFILER_DISTURBED_RETRIES_MAX tries.
+    u32* context_switches;
+    u32* page_faults;
+    // With track_memory: the most bytes of scratch space and of stack that the target used.
+    u64* scratch_peak;
+    u32* stack_peak;
+    // Where each unit's input was sampled from, so that it may be re-created (rarely read).
+    RandState* seed;
+} ProfilerResultUnits;
+
+// Summary statistics for a batch of test units. The groups are kept in order of n.
 typedef struct
 {
     f64 n;
@@ -98,6 +295,15 @@ typedef struct
     f64 time_max;
     f64 time_mean;
     f64 time_median;
+    f64 time_stddev;  // Sample standard deviation.
+    f64 time_stderr;  // Standard error of the mean.
+    f64 time_ci95;    // Half-width of the 95% confidence interval for the mean.
+    f64 time_percentiles[PROFILER_PERCENTILES_MAX];  // See ProfilerParams.percentiles.
+    f64 scratch_peak;  // Bytes; the most over the group's units (0 unless track_memory).
+    f64 stack_peak;    // Likewise.
+    u32 batch_size;  // Calls of the target per timed block (1 unless batching).
+    u32 unit_offset;  // The group's units are units[unit_offset .. unit_offset + unit_count - 1].
+    u32 unit_count;   // Less than the sample size if adaptive sampling stopped early.
 } ProfilerResultGroup;
 
 typedef struct
@@ -118,26 +324,193 @@ typedef struct
     u32* input_clone;  // For verifier.
     u32* output;  // Not used by problems that operate in-place.
 
-    ProfilerResultUnit* units;
+    ProfilerResultUnits units;
     ProfilerResultGroup* groups;
 
-    f32* progress;  // Between 0 and 1.
-    u32* verification_accept_count;
+    // NOTE The following are published by the profiler with atomic stores, and may be read by other
+    // threads (with atomic loads) while the profiler is running. Nothing here is protected by a
+    // lock, so that readers can never stall the profiler.
+    u64 volatile* invocations_completed;  // Progress: target invocations so far...
+    u64 volatile* invocations_total;      // ... out of this many.
+    u32 volatile* units_published;  // units[0 .. units_published-1] hold at least one measurement.
+    u32 volatile* groups_valid;  // groups[0 .. groups_valid-1] hold summary statistics.
+                                 // (Grid refinement inserts groups among the valid ones.)
+    u32 volatile* groups_seq;  // Seqlock for `groups`: odd while the profiler is writing them.
+
+    u32* verification_accept_count;  // Out of units_published units.
+    u32* remeasurements;  // Measurements thrown away because they were disturbed.
+    HugePagesID* huge_pages;  // The pages that the buffers actually got (see params.huge_pages).
+    bool* memory_locked;  // Whether params.lock_memory succeeded.
+    i32* numa_node_worker;  // Where the run was measured: the worker's NUMA node (-1: unknown).
+    i32* numa_node_memory;  // The NUMA node that the input ended up on (-1: unknown).
+    bool* timed_out;  // The run was cut short by unit_timeout_ms or run_budget_s.
+    ProfilerErrorID* error;  // Set by the profiler if it had to give up on the run.
 } ProfilerResult;
 
+// How the profiler measures a group, as decided in the first repetition; later repetitions must
+// measure the same units in the same way.
+typedef struct
+{
+    u32 batch_size;
+    u32 unit_offset;  // Units are stored contiguously, in the order in which they're measured.
+    u32 unit_count;
+} ProfilerGroupPlan;
+
+// For talking with the profiler while it's running in another thread.
 typedef struct
 {
-    THREAD_EVENT abort_event;
-    THREAD_MUTEX result_mutex;
+    u32 volatile* abort_flag;  // Set to nonzero (atomically) to ask the profiler to abort.
 } ProfilerSync;
 
 
 /**** Functions ****/
 
+// Return true if the timing method can be used on this host.
+bool timing_method_available(TimingMethodID tmid, HostInfo* host)
+{
+    TimingMethod* tm = &timing_methods[tmid];
+    return tm->available[host->os] &&
+        (tm->perf_event == PERF_EVENT_NONE || host->has_perf_event[tm->perf_event]);
+}
+
+// Return the least n whose input and output together take up at least `bytes` bytes.
+u32 n_for_working_set(u64 bytes)
+{
+    u32 lower = 0;
+    u32 upper = U32_MAX;
+    while (lower < upper) {
+        u32 mid = lower + (upper - lower) / 2;
+        if (input_size(mid) + output_size(mid) >= bytes) {
+            upper = mid;
+        } else {
+            lower = mid + 1;
+        }
+    }
+    return lower;
+}
+
+// Recompute the sweep's values of n. This must be called whenever the cache sizes or per_cache
+// change.
+void cache_sweep_update(ProfilerCacheSweep* sweep)
+{
+    u32 per_cache = MIN(sweep->per_cache, (u32)PROFILER_CACHE_SWEEP_PER_CACHE_MAX);
+    u32 count = 0;
+    for (u32 c = 0; c < ARRAY_SIZE(sweep->cache_sizes); ++c) {
+        if (sweep->cache_sizes[c] == 0) {
+            continue;
+        }
+        for (u32 k = 0; k < per_cache; ++k) {
+            // From 2^-1 to 2^1 times the cache size; just the size itself if there's one value.
+            f64 exponent = (per_cache == 1) ? 0.0 : 2.0 * k / (per_cache - 1) - 1.0;
+            u64 bytes = (u64)round(sweep->cache_sizes[c] * pow(2.0, exponent));
+            // Insert in order, unless it's already there.
+            u32 n = n_for_working_set(bytes);
+            u32 pos = count;
+            while (pos > 0 && sweep->ns[pos - 1] > n) {
+                --pos;
+            }
+            if (pos > 0 && sweep->ns[pos - 1] == n) {
+                continue;
+            }
+            memmove(&sweep->ns[pos + 1], &sweep->ns[pos], (count - pos) * sizeof(*sweep->ns));
+            sweep->ns[pos] = n;
+            ++count;
+        }
+    }
+    sweep->ns_count = count;
+}
+
+void cache_sweep_repair(ProfilerCacheSweep* sweep)
+{
+    sweep->per_cache = CLAMP(sweep->per_cache, 1u, (u32)PROFILER_CACHE_SWEEP_PER_CACHE_MAX);
+    cache_sweep_update(sweep);
+}
+
+// Set the sweep's cache sizes to those of the host.
+void cache_sweep_from_host(ProfilerCacheSweep* sweep, HostInfo const* host)
+{
+    sweep->cache_sizes[0] = host->cpu_cache_l1;
+    sweep->cache_sizes[1] = host->cpu_cache_l2;
+    sweep->cache_sizes[2] = host->cpu_cache_l3;
+    cache_sweep_update(sweep);
+}
+
+// Return the least value of n in the sweep that is greater than n (or, if `first` is set, the
+// least value of all). If there is none, return n.
+u32 cache_sweep_next(ProfilerCacheSweep const* sweep, u32 n, bool first)
+{
+    if (sweep->ns_count == 0) {
+        return n;
+    }
+    if (first) {
+        return sweep->ns[0];
+    }
+    u32 lower = 0;
+    u32 upper = sweep->ns_count;
+    while (lower < upper) {
+        u32 mid = lower + (upper - lower) / 2;
+        if (sweep->ns[mid] > n) {
+            upper = mid;
+        } else {
+            lower = mid + 1;
+        }
+    }
+    return (lower < sweep->ns_count) ? sweep->ns[lower] : n;
+}
+
+u32 cache_sweep_count(ProfilerCacheSweep const* sweep)
+{
+    return sweep->ns_count;
+}
+
+u32 profiler_params_first_n(ProfilerParams params)
+{
+    switch (params.ns_kind) {
+    case RANGE_GEOMETRIC: return params.ns_geom.lower;
+    case RANGE_CACHES:    return cache_sweep_next(&params.ns_caches, 0, true);
+    default:              return params.ns.lower;
+    }
+}
+
+// Return the value of n that follows n in the run (n must not be the last).
+u32 profiler_params_next_n(ProfilerParams params, u32 n)
+{
+    switch (params.ns_kind) {
+    case RANGE_GEOMETRIC: return range_geom_u32_next(params.ns_geom, n);
+    case RANGE_CACHES:    return cache_sweep_next(&params.ns_caches, n, false);
+    default:              return n + params.ns.stride;
+    }
+}
+
+// Like loop_over_range_u32(), over the values of n in the run's grid, whichever kind of range
+// they're in. (Grid refinement only adds values between these.) The invariants must be up to date.
+#define loop_over_ns(_params, _n, _n_idx)                                   \
+    u32 (_n_idx) = 0;                                                       \
+    u32 (_n);                                                               \
+    for ((_n_idx) = 0, (_n) = profiler_params_first_n(_params);             \
+         (_n_idx) < (_params).num_groups_grid;                              \
+         ++(_n_idx),                                                        \
+         (_n) = ((_n_idx) < (_params).num_groups_grid)                      \
+             ? profiler_params_next_n((_params), (_n))                      \
+             : (_n))
+
 void profiler_params_recompute_invariants(ProfilerParams* params) {
-    params->num_groups = range_u32_count(params->ns);
+    switch (params->ns_kind) {
+    case RANGE_GEOMETRIC: {
+        params->num_groups_grid = range_geom_u32_count(params->ns_geom);
+    } break;
+    case RANGE_CACHES: {
+        params->num_groups_grid = cache_sweep_count(&params->ns_caches);
+    } break;
+    default: {
+        params->num_groups_grid = range_u32_count(params->ns);
+    } break;
+    }
+    params->num_groups = (u32)MIN(
+            (u64)params->num_groups_grid + params->refine_points, (u64)U32_MAX);
     // Check for integer overflow.
-    if ((u64)params->num_groups * (u64)params->sample_size <= (u64)U32_MAX) {
+    if ((u64)params->num_groups_grid + params->refine_points <= (u64)U32_MAX &&
+        (u64)params->num_groups * (u64)params->sample_size <= (u64)U32_MAX) {
         params->num_units = params->num_groups * params->sample_size;
     } else {
         params->num_units = 0;
@@ -148,6 +521,16 @@ bool profiler_params_valid(ProfilerParams params) {
     return params.num_units > 0;
 }
 
+// Return true if the run is to execute in a child process (see profiler_execute_fork()).
+bool profiler_params_in_process(ProfilerParams params) {
+  #ifdef _WIN32
+    (void)params;
+    return false;
+  #else
+    return params.separate_thread && params.separate_process;
+  #endif
+}
+
 ProfilerParams profiler_params_default()
 {
     ProfilerParams params;
@@ -155,7 +538,20 @@ ProfilerParams profiler_params_default()
     params.ns.lower = 0;
     params.ns.stride = 1;
     params.ns.upper = 200;
+    params.ns_geom.lower = 10;
+    params.ns_geom.per_decade = 10;
+    params.ns_geom.upper = 1000000;
+    params.ns_caches.cache_sizes[0] = 0;
+    params.ns_caches.cache_sizes[1] = 0;
+    params.ns_caches.cache_sizes[2] = 0;
+    params.ns_caches.per_cache = 9;
+    cache_sweep_update(&params.ns_caches);
+    params.ns_kind = RANGE_ARITHMETIC;
+    params.refine_points = 0;
     params.sample_size = 10;
+    params.precision_pct = 0.0f;
+    params.sample_size_min = 5;
+    params.precision_of_median = false;
     params.seed = 0;
     params.seed_from_time = false;
 
@@ -164,18 +560,167 @@ ProfilerParams profiler_params_default()
     params.verifier_enabled = true;
     params.verifier_idx = 0;
     params.separate_thread = true;
+  #ifdef _WIN32
+    params.separate_process = false;
+  #else
+    params.separate_process = true;
+  #endif
+    params.run_alone = false;
     params.warmup_ms = 100;
     params.repetitions = 20;
+    params.stable_repetitions = 0;
     params.timing = TIMING_RDTSC;
     params.adjust_for_timer_overhead = false;
+    params.reject_disturbed = false;
+    params.unit_timeout_ms = 10000;
+    params.run_budget_s = 0;
+    params.batch_target_us = 0;
+    params.huge_pages = HUGE_PAGES_NONE;
+    params.lock_memory = false;
+    params.cache_state = CACHE_HOT;
+    params.track_memory = false;
+    params.numa_placement = NUMA_ANY;
+    params.percentiles_count = ARRAY_SIZE(profiler_percentiles_default);
+    memcpy(params.percentiles, profiler_percentiles_default, sizeof(profiler_percentiles_default));
 
     profiler_params_recompute_invariants(&params);
 
     return params;
 }
 
+// Parse a comma-separated list of percentiles, such as "1, 5, 95, 99", into params->percentiles.
+// There may be at most PROFILER_PERCENTILES_MAX of them, each strictly between 0 and 100, in
+// increasing order; an empty list means none.
+//
+// Return: false if the list is invalid, in which case `params` is left alone.
+//
+bool profiler_params_parse_percentiles(ProfilerParams* params, char const* str)
+{
+    f64 percentiles[PROFILER_PERCENTILES_MAX];
+    u32 count = 0;
+    char const* c = str;
+    while (*c == ' ') ++c;
+    while (*c != '\0') {
+        f64 value = 0.0;
+        i32 len = 0;
+        if (count == PROFILER_PERCENTILES_MAX ||
+            sscanf(c, "%lf%n", &value, &len) != 1 ||
+            !(value > 0.0 && value < 100.0) ||
+            (count > 0 && value <= percentiles[count - 1])) {
+            return false;
+        }
+        percentiles[count++] = value;
+        c += len;
+        while (*c == ' ') ++c;
+        if (*c == ',') {
+            ++c;
+            while (*c == ' ') ++c;
+            if (*c == '\0') {
+                return false;  // Trailing comma.
+            }
+        } else if (*c != '\0') {
+            return false;
+        }
+    }
+    memcpy(params->percentiles, percentiles, count * sizeof(*percentiles));
+    params->percentiles_count = count;
+    return true;
+}
+
+// Write the percentiles as a list that profiler_params_parse_percentiles() reads back.
+void profiler_params_format_percentiles(ProfilerParams params, char* buf, usize buf_len)
+{
+    usize pos = 0;
+    if (buf_len > 0) {
+        buf[0] = '\0';
+    }
+    for (u32 p = 0; p < params.percentiles_count && pos < buf_len; ++p) {
+        i32 written = snprintf(buf + pos, buf_len - pos, "%s%g", p > 0 ? ", " : "",
+                               params.percentiles[p]);
+        if (written < 0) break;
+        pos += (usize)written;
+    }
+}
+
+// Return the distance, in elements, between consecutive inputs of size n in a batch.
+u64 input_stride(u32 n)
+{
+    return (input_size(n) + sizeof(u32) - 1) / sizeof(u32);
+}
+
+// Return the number of bytes to set aside for the target's input. When batching, this is enough
+// for many inputs at once (see profiler_calibrate_batch_size()), up to a fixed memory budget.
+u64 profiler_params_input_capacity(ProfilerParams params)
+{
+    u64 input_size_max = 0;
+    loop_over_ns(params, n, n_idx) {
+        input_size_max = MAX(input_size_max, input_stride(n) * sizeof(u32));
+    }
+    if (params.batch_target_us != 0) {
+        u64 batch_memory = MIN(
+                input_size_max * PROFILER_BATCH_SIZE_MAX,
+                (u64)PROFILER_BATCH_MEMORY_MAX);
+        input_size_max = MAX(input_size_max, batch_memory);
+    }
+    return input_size_max;
+}
+
+// Return the number of bytes of scratch memory that the profiler will need for this run: Enough
+// for the largest n, for the target's scratch buffer plus whatever the sampler and verifier need,
+// on top of the space for computing summary statistics and remembering how each group is measured
+// (which is held throughout the run), and for refining the grid.
+u64 profiler_params_scratch_size(ProfilerParams params)
+{
+    fn_size target_size = targets[params.target_idx].scratch_size;
+    fn_size sampler_size = samplers[params.sampler_idx].scratch_size;
+    fn_size verifier_size = params.verifier_enabled
+        ? verifiers[params.verifier_idx].scratch_size
+        : NULL;
+    u64 size_max = 0;
+    loop_over_ns(params, n, n_idx) {
+        u64 size_n = 0;
+        size_n += target_size ? target_size(n) : 0;
+        size_n += sampler_size ? sampler_size(n) : 0;
+        size_n += verifier_size ? verifier_size(n) : 0;
+        size_max = MAX(size_max, size_n);
+    }
+    return
+        (u64)params.sample_size * sizeof(f64) +
+        (u64)params.num_groups * (sizeof(ProfilerGroupPlan) + sizeof(u32)) +
+        (u64)params.num_units * sizeof(u32) +
+        MAX(size_max, (u64)params.num_groups * (sizeof(u32) + 2 * sizeof(f64)));
+}
+
 void profiler_result_destroy(ProfilerResult* result);
 
+// Return the number of bytes that the run's results take up for each unit (see
+// ProfilerResultUnits), not counting alignment.
+u64 profiler_result_unit_size(ProfilerParams params)
+{
+    u64 size = 2 * sizeof(f64) + sizeof(RandState);
+    if (params.reject_disturbed) {
+        size += 2 * sizeof(u32);
+    }
+    if (params.track_memory) {
+        size += sizeof(u64) + sizeof(u32);
+    }
+    return size;
+}
+
+// Push an array of `count` elements of the given size for the units, starting on a cache line, so
+// that a pass over it touches no more cache lines than it must. The array isn't written to (see
+// profiler_result_create()).
+//
+// Return: pointer to the array on success; null on error.
+//
+static void* profiler_result_push_units(Arena* a, u32 count, usize elem_size)
+{
+    if (!arena_align(a, PROFILER_UNITS_ALIGNMENT)) {
+        return NULL;
+    }
+    return arena_push(a, (usize)count * elem_size);
+}
+
 // Initialize result. On failure, make a stub (return {0}).
 //
 // If this call succeeds (i.e., returns a non-stub) then the caller must eventually call
@@ -185,10 +730,11 @@ ProfilerResult profiler_result_create(ProfilerParams params)
     ProfilerResult result = {0};
     bool clone_input = params.verifier_enabled;
     usize arena_len_required = 0;
+    u64 input_capacity = profiler_params_input_capacity(params);
     u64 input_size_max = 0;
     u64 output_size_max = 0;
 
-    loop_over_range_u32(params.ns, n, n_idx) {
+    loop_over_ns(params, n, n_idx) {
         u64 input_size_n = input_size(n);
         input_size_max = MAX(input_size_max, input_size_n);
         u64 output_size_n = output_size(n);
@@ -202,17 +748,34 @@ ProfilerResult profiler_result_create(ProfilerParams params)
 
     // Reserve local memory for the result.
 
-    // Memory for one or two copies of the input.
-    arena_len_required += (1 + (u32)clone_input) * input_size_max;
+    // Memory for the input (or a batch of inputs), and maybe a copy of the first one.
+    arena_len_required += input_capacity + (u32)clone_input * input_size_max;
     // Memory for output (if required).
     arena_len_required += output_size_max;
-    // Result data.
-    arena_len_required += params.num_units * sizeof(ProfilerResultUnit);
+    // Result data, with room to align each of the units' arrays (see profiler_result_push_units())
+    // and the groups.
+    arena_len_required += (u64)params.num_units * profiler_result_unit_size(params);
+    arena_len_required += 8 * PROFILER_UNITS_ALIGNMENT;
     arena_len_required += params.num_groups * sizeof(ProfilerResultGroup);
+    arena_len_required += PROFILER_COUNTERS_ALIGNMENT;  // For aligning the counters.
+    arena_len_required += sizeof(*result.invocations_completed);
+    arena_len_required += sizeof(*result.invocations_total);
     arena_len_required += sizeof(*result.verification_accept_count);
-    arena_len_required += sizeof(*result.progress);
-
-    result.local_arena = arena_create(arena_len_required);
+    arena_len_required += sizeof(*result.remeasurements);
+    arena_len_required += sizeof(*result.huge_pages);
+    arena_len_required += sizeof(*result.numa_node_worker);
+    arena_len_required += sizeof(*result.numa_node_memory);
+    arena_len_required += sizeof(*result.units_published);
+    arena_len_required += sizeof(*result.groups_valid);
+    arena_len_required += sizeof(*result.groups_seq);
+    arena_len_required += sizeof(*result.error);
+    arena_len_required += sizeof(*result.memory_locked);
+    arena_len_required += sizeof(*result.timed_out);
+
+    // A child process can only hand its results back through shared memory. The input and output
+    // live here too, so this is where huge pages matter most.
+    result.local_arena = arena_create_huge(
+            arena_len_required, profiler_params_in_process(params), params.huge_pages);
     if (!result.local_arena.data) {
         // Failed to allocate memory arena.
         goto error_memory;
@@ -220,30 +783,98 @@ ProfilerResult profiler_result_create(ProfilerParams params)
 
     // Initialize the result struct.
 
-    result.input = (u32*)arena_push_zero(&result.local_arena, input_size_max);
+    // The arena is freshly mapped, so the buffers, units and groups are already zero. They're left
+    // untouched, so that their pages are first touched (and so placed on a NUMA node) by the worker,
+    // after it has bound them; see profiler_execute(). Pages that were touched here, before a fork,
+    // would be shared with the child, and the kernel wouldn't move them.
+    result.input = (u32*)arena_push(&result.local_arena, input_capacity);
     if (clone_input) {
-        result.input_clone = (u32*)arena_push_zero(&result.local_arena, input_size_max);
+        result.input_clone = (u32*)arena_push(&result.local_arena, input_size_max);
     } else {
         result.input_clone = NULL;
     }
     if (output_size_max != 0) {
-        result.output = (u32*)arena_push_zero(&result.local_arena, output_size_max);
+        result.output = (u32*)arena_push(&result.local_arena, output_size_max);
     } else {
         result.output = NULL;
     }
-    result.units = arena_push_array_zero(
-            &result.local_arena, ProfilerResultUnit, params.num_units);
-    if (!result.units) goto error_memory;
-    result.groups = arena_push_array_zero(
+    result.units.n = (f64*)profiler_result_push_units(
+            &result.local_arena, params.num_units, sizeof(*result.units.n));
+    if (!result.units.n) goto error_memory;
+    result.units.time = (f64*)profiler_result_push_units(
+            &result.local_arena, params.num_units, sizeof(*result.units.time));
+    if (!result.units.time) goto error_memory;
+    result.units.seed = (RandState*)profiler_result_push_units(
+            &result.local_arena, params.num_units, sizeof(*result.units.seed));
+    if (!result.units.seed) goto error_memory;
+    result.units.scratch_peak = NULL;
+    result.units.stack_peak = NULL;
+    if (params.track_memory) {
+        result.units.scratch_peak = (u64*)profiler_result_push_units(
+                &result.local_arena, params.num_units, sizeof(*result.units.scratch_peak));
+        if (!result.units.scratch_peak) goto error_memory;
+        result.units.stack_peak = (u32*)profiler_result_push_units(
+                &result.local_arena, params.num_units, sizeof(*result.units.stack_peak));
+        if (!result.units.stack_peak) goto error_memory;
+    }
+    result.units.context_switches = NULL;
+    result.units.page_faults = NULL;
+    if (params.reject_disturbed) {
+        result.units.context_switches = (u32*)profiler_result_push_units(
+                &result.local_arena, params.num_units, sizeof(*result.units.context_switches));
+        if (!result.units.context_switches) goto error_memory;
+        result.units.page_faults = (u32*)profiler_result_push_units(
+                &result.local_arena, params.num_units, sizeof(*result.units.page_faults));
+        if (!result.units.page_faults) goto error_memory;
+    }
+    if (!arena_align(&result.local_arena, sizeof(f64))) goto error_memory;
+    result.groups = arena_push_array(
             &result.local_arena, ProfilerResultGroup, params.num_groups);
     if (!result.groups) goto error_memory;
 
+    // The counters are zeroed here, so they go on a page of their own. The rest in order of
+    // decreasing size, so that each is aligned. (The 64-bit counters are stored atomically, so they
+    // must be aligned whatever the size of the buffers before them.)
+    if (!arena_align(&result.local_arena, PROFILER_COUNTERS_ALIGNMENT)) goto error_memory;
+    result.invocations_completed = (u64*)arena_push_zero(
+            &result.local_arena, sizeof(*result.invocations_completed));
+    if (!result.invocations_completed) goto error_memory;
+    result.invocations_total = (u64*)arena_push_zero(
+            &result.local_arena, sizeof(*result.invocations_total));
+    if (!result.invocations_total) goto error_memory;
     result.verification_accept_count = (u32*)arena_push_zero(
             &result.local_arena, sizeof(*result.verification_accept_count));
     if (!result.verification_accept_count) goto error_memory;
-    result.progress = (f32*)arena_push_zero(
-            &result.local_arena, sizeof(*result.progress));
-    if (!result.progress) goto error_memory;
+    result.remeasurements = (u32*)arena_push_zero(
+            &result.local_arena, sizeof(*result.remeasurements));
+    if (!result.remeasurements) goto error_memory;
+    result.huge_pages = (HugePagesID*)arena_push_zero(
+            &result.local_arena, sizeof(*result.huge_pages));
+    if (!result.huge_pages) goto error_memory;
+    result.numa_node_worker = (i32*)arena_push_zero(
+            &result.local_arena, sizeof(*result.numa_node_worker));
+    if (!result.numa_node_worker) goto error_memory;
+    result.numa_node_memory = (i32*)arena_push_zero(
+            &result.local_arena, sizeof(*result.numa_node_memory));
+    if (!result.numa_node_memory) goto error_memory;
+    result.units_published = (u32*)arena_push_zero(
+            &result.local_arena, sizeof(*result.units_published));
+    if (!result.units_published) goto error_memory;
+    result.groups_valid = (u32*)arena_push_zero(
+            &result.local_arena, sizeof(*result.groups_valid));
+    if (!result.groups_valid) goto error_memory;
+    result.groups_seq = (u32*)arena_push_zero(
+            &result.local_arena, sizeof(*result.groups_seq));
+    if (!result.groups_seq) goto error_memory;
+    result.error = (ProfilerErrorID*)arena_push_zero(
+            &result.local_arena, sizeof(*result.error));
+    if (!result.error) goto error_memory;
+    result.memory_locked = (bool*)arena_push_zero(
+            &result.local_arena, sizeof(*result.memory_locked));
+    if (!result.memory_locked) goto error_memory;
+    result.timed_out = (bool*)arena_push_zero(
+            &result.local_arena, sizeof(*result.timed_out));
+    if (!result.timed_out) goto error_memory;
 
     result.valid = true;
     return result;
@@ -253,6 +884,39 @@ error_memory:
     return result;
 }
 
+// Return the fraction (between 0 and 1) of the run that the profiler has completed. Safe to call
+// from any thread while the profiler is running.
+f32 profiler_result_progress(ProfilerResult result)
+{
+    u64 total = atomic_load_u64(result.invocations_total);
+    u64 completed = atomic_load_u64(result.invocations_completed);
+    return (total == 0) ? 0.0f : (f32)completed / (f32)total;
+}
+
+// Copy the result's groups into `dst` (an array of params.num_groups elements), without tearing.
+// Safe to call from any thread while the profiler is running. Return false if the profiler kept
+// writing the groups throughout all our attempts to read them; in that case, `dst` is garbage.
+bool profiler_result_read_groups(
+        ProfilerParams params,
+        ProfilerResult result,
+        ProfilerResultGroup* dst)
+{
+    // Don't retry for too long: the caller is probably the GUI thread.
+    for (u32 attempt = 0; attempt < 4; ++attempt) {
+        u32 seq_before = atomic_load_u32(result.groups_seq);
+        if (seq_before & 1) {
+            continue;  // Write in progress.
+        }
+        memcpy(dst, result.groups, params.num_groups * sizeof(*dst));
+        atomic_fence_acquire();
+        u32 seq_after = atomic_load_u32(result.groups_seq);
+        if (seq_before == seq_after) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void profiler_result_destroy(ProfilerResult* result)
 {
     arena_destroy(&result->local_arena);
@@ -330,75 +994,149 @@ u64 get_clock_gettime_period()
     #endif
 }
 
-// Return the value of the given timer.
-/* We prevent inlining because the compiler might inline some calls and not others, which would
-   interfere with timings (e.g., adjust_for_timer_overhead would be spoiled). */
-NEVER_INLINE
-u64 get_timer_value(TimingMethodID tmid)
+// Timer reads, for the measurement kernels below. These are always inlined, so that nothing but
+// the call to the target happens between the two reads of a measurement.
+
+// RDTSC neither waits for the preceding instructions to complete, nor keeps the following ones from
+// starting early; the fences do both. (See Intel's white paper, "How to Benchmark Code Execution
+// Times on Intel IA-32 and IA-64 Instruction Set Architectures".)
+static ALWAYS_INLINE u64 timer_read_rdtsc()
 {
-    // This is branchy, but not overly so. If the user cares about the extra dozen instructions due
-    // to calling this function (as opposed to calling, say, __rdtsc() directly), they can adjust by
-    // subtracting get_timer_overhead().
+    _mm_lfence();
+    u64 tsc = __rdtsc();
+    _mm_lfence();
+    return tsc;
+}
+
+// For the end of a measurement: RDTSCP itself waits for the target's instructions to complete, so
+// we only need the fence to keep the following instructions from starting early.
+static ALWAYS_INLINE u64 timer_read_rdtscp()
+{
+    u32 aux;
+    u64 tsc = __rdtscp(&aux);
+    _mm_lfence();
+    return tsc;
+}
+
+static ALWAYS_INLINE u64 timer_read_qpc()
+{
+    #ifdef _WIN32
+    LARGE_INTEGER qpc_now;
+    QueryPerformanceCounter(&qpc_now);
+    return qpc_now.QuadPart;
+    #else
+    assertm(false, "The requested timing method is unavailable on this platform.");
+    return 0;
+    #endif
+}
+
+static ALWAYS_INLINE u64 timer_read_qtct()
+{
+    #ifdef _WIN32
+    u64 time_now;
+    THREAD current_thread = GetCurrentThread();
+    QueryThreadCycleTime(current_thread, &time_now);
+    return time_now;
+    #else
+    assertm(false, "The requested timing method is unavailable on this platform.");
+    return 0;
+    #endif
+}
+
+static ALWAYS_INLINE u64 timer_read_qpct()
+{
+    #ifdef _WIN32
+    u64 time_now;
+    PROCESS current_process = GetCurrentProcess();
+    QueryProcessCycleTime(current_process, &time_now);
+    return time_now;
+    #else
+    assertm(false, "The requested timing method is unavailable on this platform.");
+    return 0;
+    #endif
+}
+
+static ALWAYS_INLINE u64 timer_read_clock_gettime()
+{
+    #ifdef _WIN32
+    assertm(false, "The requested timing method is unavailable on this platform.");
+    return 0;
+    #else
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        return 0;
+    }
+    return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+    #endif
+}
+
+// Measure `count` consecutive calls of the target, on inputs `stride` elements apart starting at
+// `data`: return the difference between timer readings taken just before the first call and just
+// after the last.
+typedef u64 (*fn_measure)(
+        fn_target target, u32* data, u64 stride, u32 count, u32 n, RandState* rs, void* scratch);
 
-    // Another way to do this more efficiently would be to re-structure: Move the switch statment to
-    // the target call, instead calling the target inside each case. The rdtsc could be done with
-    // inline asm. But this is all very much overkill for our application, at least for the time
-    // being.
+// Measurement kernels: one per way of reading the timer, so that there's no branching (and no
+// function call, other than the target) inside the timed region. The kernels themselves are never
+// inlined, so that every measurement runs the exact same code, and get_timer_overhead() measures
+// that same code too.
+//
+//  X(name, read at start, read at end)
+#define FOR_MEASUREMENT_KERNELS \
+    X(rdtsc,         timer_read_rdtsc,         timer_read_rdtsc)         \
+    X(rdtsc_rdtscp,  timer_read_rdtsc,         timer_read_rdtscp)        \
+    X(qpc,           timer_read_qpc,           timer_read_qpc)           \
+    X(qtct,          timer_read_qtct,          timer_read_qtct)          \
+    X(qpct,          timer_read_qpct,          timer_read_qpct)          \
+    X(clock_gettime, timer_read_clock_gettime, timer_read_clock_gettime) \
+    X(perf,          perf_counter_read,        perf_counter_read)        \
+
+#define X(_name, _read_start, _read_end)                                    \
+NEVER_INLINE                                                                \
+u64 measure_##_name(                                                        \
+        fn_target target, u32* data, u64 stride, u32 count, u32 n,          \
+        RandState* rs, void* scratch)                                       \
+{                                                                           \
+    u64 timer_initial = _read_start();                                      \
+    for (u32 j = 0; j < count; ++j) {                                       \
+        target(data + j * stride, n, rs, scratch);                          \
+    }                                                                       \
+    u64 timer_final = _read_end();                                          \
+    return timer_final - timer_initial;                                     \
+}
+FOR_MEASUREMENT_KERNELS
+#undef X
 
+// Return the measurement kernel for the given timing method. For the counters, the counter must
+// already be open on the calling thread (see perf_counter_open()).
+fn_measure get_measurement_kernel(TimingMethodID tmid, HostInfo* host)
+{
     switch(tmid) {
     case TIMING_RDTSC: {
-        // The fence is probably unnecessary because we're inside our own stack frame, but we insert
-        // in anyway for good measure.
-        _mm_lfence();
-        return __rdtsc();
+        return host->has_rdtscp ? measure_rdtsc_rdtscp : measure_rdtsc;
     } break;
     case TIMING_QPC: {
-        #ifdef _WIN32
-        LARGE_INTEGER qpc_now;
-        QueryPerformanceCounter(&qpc_now);
-        return qpc_now.QuadPart;
-        #else
-        assertm(false, "The requested timing method is unavailable on this platform.");
-        return 0;
-        #endif
+        return measure_qpc;
     } break;
     case TIMING_QTCT: {
-        #ifdef _WIN32
-        u64 time_now;
-        THREAD current_thread = GetCurrentThread();
-        QueryThreadCycleTime(current_thread, &time_now);
-        return time_now;
-        #else
-        assertm(false, "The requested timing method is unavailable on this platform.");
-        return 0;
-        #endif
+        return measure_qtct;
     } break;
     case TIMING_QPCT: {
-        #ifdef _WIN32
-        u64 time_now;
-        PROCESS current_process = GetCurrentProcess();
-        QueryProcessCycleTime(current_process, &time_now);
-        return time_now;
-        #else
-        assertm(false, "The requested timing method is unavailable on this platform.");
-        return 0;
-        #endif
+        return measure_qpct;
     } break;
     case TIMING_CLOCK_GETTIME: {
-        #ifdef _WIN32
-        assertm(false, "The requested timing method is unavailable on this platform.");
-        return 0;
-        #else
-        struct timespec ts;
-        if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
-            return 0;
-        }
-        return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
-        #endif
+        return measure_clock_gettime;
+    } break;
+    case TIMING_PERF_CYCLES:
+    case TIMING_PERF_INSTRUCTIONS:
+    case TIMING_PERF_L1D_MISSES:
+    case TIMING_PERF_LLC_MISSES:
+    case TIMING_PERF_BRANCH_MISSES: {
+        return measure_perf;
     } break;
     default: {
         assertm(false, "The requested timing method is unimplemented.");
-        return 0;
+        return measure_rdtsc;
     } break;
     }
 }
@@ -436,6 +1174,14 @@ u64 get_timer_frequency(TimingMethodID tmid, HostInfo* host)
         return 1000000000ull;
         #endif
     } break;
+    case TIMING_PERF_CYCLES:
+    case TIMING_PERF_INSTRUCTIONS:
+    case TIMING_PERF_L1D_MISSES:
+    case TIMING_PERF_LLC_MISSES:
+    case TIMING_PERF_BRANCH_MISSES: {
+        assertm(false, "Counters count events, not time; there's no frequency.");
+        return 0;
+    } break;
     default: {
         assertm(false, "The requested timing method is unimplemented.");
         return 0;
@@ -443,11 +1189,17 @@ u64 get_timer_frequency(TimingMethodID tmid, HostInfo* host)
     }
 }
 
-// Get the overhead resulting from using the timer: time between successive calls. This function
-// tests a large number of repetitions to get a good measurement.
+static void target_noop(u32* data, u32 n, RandState* rs, void* scratch)
+{
+    (void)data; (void)n; (void)rs; (void)scratch;
+}
+
+// Get the overhead resulting from using the timer: what the measurement kernel measures for a
+// target that does nothing (including the call to the target itself). This function tests a large
+// number of repetitions to get a good measurement.
 // Warning: The CPU should be "warmed up" when calling this, to get up to its full (or boost)
 // frequency; otherwise, the return value may be an overestimate of the true overhead.
-u64 get_timer_overhead(TimingMethodID tmid, u32 timeout_ms)
+u64 get_timer_overhead(fn_measure measure, u32 timeout_ms)
 {
     // Our process might be pre-empted, so we need to do this many times to be very sure that we
     // don't over-estimate the overhead.
@@ -461,11 +1213,12 @@ u64 get_timer_overhead(TimingMethodID tmid, u32 timeout_ms)
 
     u64 start_time = get_ostime_count(false);
     u64 end_time = start_time + get_ostime_freq() * timeout_ms / 1000;
+    // Measure a target that does nothing. It's passed through a volatile, so that the compiler
+    // can't specialize the kernel for it.
+    fn_target volatile target = target_noop;
     u64 min_overhead = U64_MAX;
     do {
-        u64 one = get_timer_value(tmid);
-        u64 two = get_timer_value(tmid);
-        u64 overhead = two - one;
+        u64 overhead = measure(target, NULL, 0, 1, 0, NULL, NULL);
         min_overhead = MIN(overhead, min_overhead);
     } while (get_ostime_count(false) < end_time);
     return min_overhead;
@@ -480,8 +1233,14 @@ void query_host_info(HostInfo* host)
     if (!host->initialized) {
         get_cpu_brand(host->cpu_name);
         host->cpu_num_cores = get_cpu_num_logical_processors();
+        host->cpu_num_physical_cores = get_cpu_physical_core_ids(
+                host->cpu_core_ids, HOST_CORES_MAX);
+        host->numa_num_nodes = get_numa_nodes(
+                host->cpu_core_ids, host->cpu_core_nodes, host->cpu_num_physical_cores,
+                &host->numa_memory_nodes);
         get_cpu_tsc_features(
                 &host->has_tsc,
+                &host->has_rdtscp,
                 &host->has_invariant_tsc);
         get_cpu_data_cache_sizes(
                 &host->cpu_cache_l1,
@@ -490,6 +1249,9 @@ void query_host_info(HostInfo* host)
         // QPC frequency is fixed at system boot.
         host->qpc_frequency = get_qpc_frequency();
         host->clock_gettime_period = get_clock_gettime_period();
+        for (u32 i = 0; i < PERF_EVENT_ID_MAX; ++i) {
+            host->has_perf_event[i] = (i != PERF_EVENT_NONE) && perf_counter_probe((PerfEventID)i);
+        }
         #ifdef _WIN32
         host->os = OS_WIN32;
         #else
@@ -521,19 +1283,420 @@ void waste_cpu_time(u32 timeout_ms) {
 }
 
 
+// Adaptive sampling: Return true once the 95% confidence interval for the mean of the values seen
+// so far is within +/- target_precision (a fraction) of the mean.
+bool profiler_group_converged(RunningStats stats, f64 target_precision)
+{
+    if (stats.count < 2) {
+        return false;
+    }
+    f64 ci95 = student_t_975(stats.count - 1) * sqrt(running_stats_variance(stats) / stats.count);
+    return ci95 <= target_precision * fabs(stats.mean);
+}
+
+// Adaptive sampling, on the median: Like profiler_group_converged(), but for the median of the
+// units' times. The confidence interval is the distribution-free one, between the order statistics
+// whose ranks are 1.96 standard deviations of a Binomial(count, 1/2) away from the middle; unlike
+// the mean's, it isn't thrown off by a few extreme outliers (such as pre-empted units).
+// `times` is scratch space for `count` values.
+bool profiler_group_converged_median(
+        f64 const* unit_times,
+        u32 count,
+        f64* times,
+        f64 target_precision)
+{
+    f64 half_width = 1.96 * sqrt((f64)count) / 2;
+    if (half_width >= count / 2.0) {
+        return false;  // Too few units for the interval to be bounded.
+    }
+    memcpy(times, unit_times, count * sizeof(*times));
+    u32 rank_lower = (u32)floor(count / 2.0 - half_width);
+    u32 rank_upper = MIN((u32)ceil(count / 2.0 + half_width), count - 1);
+    util_select(times, count, rank_lower);
+    f64 lower = times[rank_lower];
+    util_select(times + rank_lower, count - rank_lower, rank_upper - rank_lower);
+    f64 upper = times[rank_upper];
+    f64 median = util_quantile(times + rank_lower, rank_upper - rank_lower + 1,
+                               (count / 2.0 - 0.5 - rank_lower) / (rank_upper - rank_lower));
+    return (upper - lower) / 2 <= target_precision * fabs(median);
+}
+
+// Publish the summary statistics of a group to readers (see profiler_result_read_groups()): replace
+// the valid group with the same n, if there is one, or else insert the group in order of n among
+// the `groups_valid` valid ones. `stats` has been kept up to date as the group's units were
+// measured; only the median and the percentiles have to be computed here (by selection, not
+// sorting). `times` is scratch space for plan.unit_count values.
+void profiler_result_publish_group(
+        ProfilerParams params,
+        ProfilerResult result,
+        u32 groups_valid,
+        ProfilerGroupPlan plan,
+        RunningStats stats,
+        f64* times)
+{
+    u32 unit_count = plan.unit_count;  // For brevity.
+    ProfilerResultUnits units = result.units;  // For brevity.
+    u32 first = plan.unit_offset;
+    ProfilerResultGroup group = {0};
+    group.n = units.n[first];
+    group.batch_size = plan.batch_size;
+    group.unit_offset = plan.unit_offset;
+    group.unit_count = unit_count;
+    group.time_min = stats.min;
+    group.time_max = stats.max;
+    group.time_mean = stats.mean;
+    group.time_stddev = sqrt(running_stats_variance(stats));
+    group.time_stderr = group.time_stddev / sqrt((f64)stats.count);
+    group.time_ci95 = student_t_975(stats.count - 1) * group.time_stderr;
+    memcpy(times, &units.time[first], unit_count * sizeof(*times));
+    if (units.scratch_peak) {
+        for (u32 i = first; i < first + unit_count; ++i) {
+            group.scratch_peak = MAX(group.scratch_peak, (f64)units.scratch_peak[i]);
+            group.stack_peak = MAX(group.stack_peak, (f64)units.stack_peak[i]);
+        }
+    }
+    group.time_median = util_quantile(times, unit_count, 0.5);
+    for (u32 p = 0; p < params.percentiles_count; ++p) {
+        group.time_percentiles[p] = util_quantile(times, unit_count, params.percentiles[p] / 100);
+    }
+
+    u32 pos = 0;
+    while (pos < groups_valid && result.groups[pos].n < group.n) {
+        ++pos;
+    }
+    bool insert = pos == groups_valid || result.groups[pos].n != group.n;
+
+    // Seqlock (writer side): readers will retry if they see an odd or changed sequence number.
+    u32 seq = *result.groups_seq;
+    atomic_store_u32(result.groups_seq, seq + 1);
+    atomic_fence_release();
+    if (insert) {
+        memmove(&result.groups[pos + 1], &result.groups[pos],
+                (groups_valid - pos) * sizeof(*result.groups));
+    }
+    result.groups[pos] = group;
+    atomic_store_u32(result.groups_seq, seq + 2);
+}
+
+// Grid refinement: Choose up to `count_max` new values of n, to be measured in a second pass, where
+// the curve of the group medians bends most sharply (at a cache-capacity knee, say, or where an
+// algorithm switches strategy). `groups` holds `count` groups, in order of n. The curve is taken
+// with time on a log scale (and n too, unless the range is arithmetic), so that a bend counts the
+// same whether the times around it are large or small. Each interval between neighbouring values of
+// n is scored by how far the curve could stray from a straight line across it: the change in slope
+// at its ends, times its width. The best interval is split at its midpoint, each half taking half
+// of its score, and so on; an interval is never split so finely that n would repeat.
+//
+// Return: the number of values written to ns_new, most important first.
+//
+u32 profiler_refine_grid(
+        ProfilerParams params,
+        ProfilerResultGroup const* groups,
+        u32 count,
+        u32* ns_new,
+        u32 count_max)
+{
+    if (count < 2) {
+        return 0;
+    }
+    ArenaTmp scratch = scratch_get(NULL, 0);
+    u32 points_max = count + count_max;
+    u32* ns = arena_push_array(scratch.a, u32, points_max);
+    f64* scores = arena_push_array(scratch.a, f64, points_max);  // For the interval after each n.
+    f64* slopes = arena_push_array(scratch.a, f64, count);
+    bool log_n = params.ns_kind != RANGE_ARITHMETIC;
+    #define REFINE_X(_n) (log_n ? log((f64)(_n)) : (f64)(_n))
+
+    for (u32 i = 0; i < count; ++i) {
+        ns[i] = (u32)groups[i].n;
+    }
+    for (u32 i = 0; i + 1 < count; ++i) {
+        slopes[i] =
+            (log1p(MAX(groups[i + 1].time_median, 0.0)) - log1p(MAX(groups[i].time_median, 0.0))) /
+            (REFINE_X(ns[i + 1]) - REFINE_X(ns[i]));
+    }
+    for (u32 i = 0; i + 1 < count; ++i) {
+        f64 bend = 0.0;
+        bend += (i > 0) ? fabs(slopes[i] - slopes[i - 1]) : 0.0;
+        bend += (i + 2 < count) ? fabs(slopes[i + 1] - slopes[i]) : 0.0;
+        scores[i] = bend * (REFINE_X(ns[i + 1]) - REFINE_X(ns[i]));
+    }
+
+    u32 points = count;
+    u32 added = 0;
+    while (added < count_max) {
+        // Pick the interval with the best score, or (if the curve is straight) the widest.
+        u32 best = U32_MAX;
+        for (u32 i = 0; i + 1 < points; ++i) {
+            if (ns[i + 1] - ns[i] < 2) {
+                continue;
+            }
+            if (best == U32_MAX || scores[i] > scores[best] ||
+                (scores[i] == scores[best] &&
+                 REFINE_X(ns[i + 1]) - REFINE_X(ns[i]) >
+                 REFINE_X(ns[best + 1]) - REFINE_X(ns[best]))) {
+                best = i;
+            }
+        }
+        if (best == U32_MAX) {
+            break;  // Every interval is down to consecutive integers.
+        }
+        u32 lower = ns[best];
+        u32 upper = ns[best + 1];
+        u32 mid = log_n
+            ? (u32)round(sqrt((f64)lower * (f64)upper))
+            : lower + (upper - lower) / 2;
+        mid = CLAMP(mid, lower + 1, upper - 1);
+        memmove(&ns[best + 2], &ns[best + 1], (points - best - 1) * sizeof(*ns));
+        memmove(&scores[best + 1], &scores[best], (points - best - 1) * sizeof(*scores));
+        ns[best + 1] = mid;
+        scores[best] /= 2;
+        scores[best + 1] = scores[best];
+        ++points;
+        ns_new[added++] = mid;
+    }
+
+    #undef REFINE_X
+    scratch_release(scratch);
+    return added;
+}
+
+// Flush the given memory from every level of cache, writing it back to memory if it's dirty.
+#define CACHE_LINE_SIZE 64
+void cache_flush(void const* data, u64 len)
+{
+    if (len == 0) {
+        return;
+    }
+    char const* begin = (char const*)data;
+    char const* end = begin + len;
+    begin -= (usize)begin % CACHE_LINE_SIZE;
+    for (char const* line = begin; line < end; line += CACHE_LINE_SIZE) {
+        _mm_clflush(line);
+    }
+    _mm_mfence();
+}
+
+// Read through the given buffer, one cache line at a time. If the buffer is larger than the
+// private caches (L1 and L2) but smaller than the last-level cache, this leaves whatever was in the
+// private caches in the last-level cache only.
+void cache_evict_private(byte const* buffer, usize len)
+{
+    byte volatile const* data = buffer;
+    for (usize i = 0; i < len; i += CACHE_LINE_SIZE) {
+        (void)data[i];
+    }
+}
+
+// Fill the target's scratch space with PROFILER_MEMORY_PAINT.
+void scratch_paint(void* data, u64 len)
+{
+    if (len != 0) {
+        memset(data, PROFILER_MEMORY_PAINT, len);
+    }
+}
+
+// Return the number of bytes of the scratch space that the target used since scratch_paint(): up to
+// the last byte that no longer holds the paint. (A write of the paint value itself goes unseen.)
+u64 scratch_used(void const* data, u64 len)
+{
+    byte const* bytes = (byte const*)data;
+    u64 used = len;
+    while (used > 0 && bytes[used - 1] == PROFILER_MEMORY_PAINT) {
+        --used;
+    }
+    return used;
+}
+
+// Fill the stack below the caller's frame with PROFILER_MEMORY_PAINT (if `paint`), or find how
+// deep into it something has written since. Both calls must come from the same function, with
+// only the call to be watched in between, so that `region` lands in the same place each time.
+//
+// Return: when not painting, the depth in bytes (to within the size of this function's frame).
+//
+NEVER_INLINE u32 stack_watch(bool paint)
+{
+    u64 region_storage[PROFILER_STACK_WATCH_SIZE / sizeof(u64)];
+    // Accessed only through a volatile pointer, which the compiler can't see through: the region
+    // is (deliberately) read without having been written in this call.
+    u64 volatile* volatile region = region_storage;
+    u64 const pattern = 0x0101010101010101ull * PROFILER_MEMORY_PAINT;
+    u32 count = (u32)ARRAY_SIZE(region_storage);
+    if (paint) {
+        for (u32 i = 0; i < count; ++i) {
+            region[i] = pattern;
+        }
+        return 0;
+    }
+    // The stack grows down, so the deepest write is the first one from the bottom.
+    u32 untouched = 0;
+    while (untouched < count && region[untouched] == pattern) {
+        ++untouched;
+    }
+    return (count - untouched) * (u32)sizeof(u64);
+}
+
+// Return the NUMA node to put memory on for the given placement, when the worker is on
+// `worker_node`: for a local placement, that node itself; for a remote placement, the next node
+// after it (wrapping around) that has memory.
+//
+// Return: true on success; false if there's no such node, or (for a local placement) if the
+// worker's node has no memory of its own.
+//
+bool numa_node_for_placement(
+        NumaPlacementID placement, HostInfo const* host, u32 worker_node, u32* memory_node)
+{
+    u32 bits = 8 * sizeof(host->numa_memory_nodes);
+    if (worker_node >= bits) {
+        return false;
+    }
+    if (placement == NUMA_LOCAL) {
+        *memory_node = worker_node;
+        return (host->numa_memory_nodes & (1ull << worker_node)) != 0;
+    }
+    for (u32 k = 1; k < bits; ++k) {
+        u32 node = (worker_node + k) % bits;
+        if (host->numa_memory_nodes & (1ull << node)) {
+            *memory_node = node;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Find how many consecutive calls of the target on inputs of size n it takes to fill
+// params.batch_target_us, by timing ever-larger batches (by wall clock, whatever the timing
+// method). The batch is capped by PROFILER_BATCH_SIZE_MAX and by how many inputs fit into
+// result.input, which holds `input_capacity` bytes (see profiler_params_input_capacity()). The
+// random state is passed by value, so the calibration doesn't disturb the sample.
+u32 profiler_calibrate_batch_size(
+        ProfilerParams params,
+        ProfilerResult result,
+        u64 input_capacity,
+        u32 n,
+        RandState rand_state)
+{
+    fn_sampler sampler = samplers[params.sampler_idx].fn;
+    fn_target target = targets[params.target_idx].fn;
+    fn_size scratch_size = targets[params.target_idx].scratch_size;
+    u64 stride = input_stride(n);
+    u64 capacity = input_capacity / sizeof(u32);
+    u32 batch_size_max = PROFILER_BATCH_SIZE_MAX;
+    if (stride != 0) {
+        batch_size_max = (u32)MIN((u64)batch_size_max, capacity / stride);
+    }
+    batch_size_max = MAX(batch_size_max, 1u);
+    u64 target_duration = get_ostime_freq() * params.batch_target_us / 1000000;
+
+    u32 batch_size = 1;
+    for (;;) {
+        ArenaTmp scratch = scratch_get(NULL, 0);
+        char* scratch_data = scratch_size
+            ? arena_push_array(scratch.a, char, scratch_size(n))
+            : NULL;
+        for (u32 j = 0; j < batch_size; ++j) {
+            sampler(result.input + j * stride, n, &rand_state, scratch.a);
+        }
+        u64 start = get_ostime_count(false);
+        for (u32 j = 0; j < batch_size; ++j) {
+            target(result.input + j * stride, n, &rand_state, scratch_data);
+        }
+        u64 duration = get_ostime_count(false) - start;
+        scratch_release(scratch);
+        if (duration >= target_duration || batch_size == batch_size_max) {
+            break;
+        }
+        batch_size = MIN(2 * batch_size, batch_size_max);
+    }
+    return batch_size;
+}
+
 void profiler_execute(
         ProfilerParams params,
         ProfilerResult result,
         HostInfo host,
         ProfilerSync sync)
 {
-    f64 timer_period_ns = 1.0e9 / (f64)get_timer_frequency(params.timing, &host);
+    // Convert timer ticks to nanoseconds. Counters count events, which we store as they are.
+    TimingMethod timing_method = timing_methods[params.timing];
+    f64 timer_period_ns = timing_method.is_timer
+        ? 1.0e9 / (f64)get_timer_frequency(params.timing, &host)
+        : 1.0;
 
     u32 sample_size = params.sample_size;  // For brevity.
+    ProfilerResultUnits units = result.units;  // Likewise.
     fn_sampler sampler = samplers[params.sampler_idx].fn;
     fn_target target = targets[params.target_idx].fn;
     fn_verifier verifier = verifiers[params.verifier_idx].fn;
     fn_size scratch_size = targets[params.target_idx].scratch_size;
+    fn_measure measure = get_measurement_kernel(params.timing, &host);
+    // This loops over all n, so don't recompute it for each group's batch calibration.
+    u64 input_capacity = profiler_params_input_capacity(params);
+
+    // Size this thread's scratch arenas for the run up front, so that no allocation happens during
+    // the measurements.
+    u64 scratch_size_max = profiler_params_scratch_size(params);
+    HugePagesID scratch_huge_pages = HUGE_PAGES_NONE;
+    if (scratch_size_max > (u64)(usize)-1 ||
+        !scratch_reserve((usize)scratch_size_max, params.huge_pages, &scratch_huge_pages)) {
+        *result.error = PROFILER_ERROR_SCRATCH_MEMORY;
+        return;
+    }
+    *result.huge_pages = MIN(result.local_arena.huge_pages, scratch_huge_pages);
+
+    // Place the memory on the requested NUMA node, before it's touched below. (The worker is pinned
+    // to a core, so its node doesn't change; if it isn't, the kernel may move it anywhere.)
+    u32 worker_node = 0;
+    bool worker_node_known = thread_get_numa_node(&worker_node);
+    *result.numa_node_worker = worker_node_known ? (i32)worker_node : -1;
+    if (params.numa_placement != NUMA_ANY) {
+        u32 memory_node = 0;
+        if (!worker_node_known ||
+            !numa_node_for_placement(params.numa_placement, &host, worker_node, &memory_node)) {
+            *result.error = PROFILER_ERROR_NUMA_NODE;
+            return;
+        }
+        if (!arena_bind_numa_node(
+                    &result.local_arena, result.local_arena.pos, memory_node) ||
+            !scratch_bind_numa_node((usize)scratch_size_max, memory_node)) {
+            *result.error = PROFILER_ERROR_NUMA_BIND;
+            return;
+        }
+    }
+
+    // Counters are per-thread, so they must be opened here, on the thread that runs the target.
+    if (timing_method.perf_event != PERF_EVENT_NONE &&
+        !perf_counter_open(timing_method.perf_event)) {
+        *result.error = PROFILER_ERROR_PERF_COUNTER;
+        return;
+    }
+
+    // For leaving the input in the last-level cache only (see cache_evict_private()).
+    Arena evict_buffer = {0};
+    if (params.cache_state == CACHE_LLC) {
+        if (host.cpu_cache_l2 == 0 || host.cpu_cache_l3 == 0) {
+            *result.error = PROFILER_ERROR_CACHE_SIZES;
+            perf_counter_close();
+            return;
+        }
+        evict_buffer = arena_create(2 * (usize)host.cpu_cache_l2);
+        if (!evict_buffer.data) {
+            *result.error = PROFILER_ERROR_SCRATCH_MEMORY;
+            perf_counter_close();
+            return;
+        }
+        arena_prefault(&evict_buffer, evict_buffer.len, false);
+    }
+
+    // Fault in (and maybe lock) all the memory that the measurements will touch, so that no page
+    // fault lands inside a measurement: the input, its clone, and the output (all in the result
+    // arena, which a child process must map afresh), the units and groups, and the scratch arenas,
+    // which are mapped lazily. This must precede the warmup, which it would otherwise interrupt.
+    bool result_locked =
+        arena_prefault(&result.local_arena, result.local_arena.pos, params.lock_memory);
+    bool scratch_locked = scratch_prefault((usize)scratch_size_max, params.lock_memory);
+    *result.memory_locked = params.lock_memory && result_locked && scratch_locked;
+    *result.numa_node_memory = numa_node_of_address(result.input);
 
     // The warmup must precede the call to get_timer_overhead().
     waste_cpu_time(params.warmup_ms);
@@ -544,7 +1707,7 @@ void profiler_execute(
     // pre-empting or other OS scheduler shenanigans). So, for now, we only measure once.
     u64 timer_overhead =
         params.adjust_for_timer_overhead
-        ? get_timer_overhead(params.timing, 1)
+        ? get_timer_overhead(measure, 1)
         : 0;
 
     // The verifier must use its own RNG state, independent from the target, because
@@ -555,126 +1718,321 @@ void profiler_execute(
         rand_init_from_time(&rand_state_verifier);
     }
 
+    // With adaptive sampling, this is an upper bound, which is lowered as each group converges.
     u64 invocations_completed = 0;
     u64 invocations_total = (u64)params.num_units * (u64)params.repetitions;
+    atomic_store_u64(result.invocations_total, invocations_total);
+
+    // Held for the whole run, for computing the summary statistics of each group as it's completed.
+    ArenaTmp stats_scratch = scratch_get(NULL, 0);
+    f64* times = arena_push_array_zero(stats_scratch.a, f64, sample_size);
+    ProfilerGroupPlan* plans =
+        arena_push_array_zero(stats_scratch.a, ProfilerGroupPlan, params.num_groups);
+    u32 units_next = 0;  // Where the next group's units go; also, the units in valid groups.
+    bool adaptive = params.precision_pct > 0.0f;
+    u32 sample_size_min = CLAMP(params.sample_size_min, 2u, sample_size);
+    // Adaptive repetitions: For each unit, the number of repetitions in a row that didn't improve
+    // on its best time. Once this reaches params.stable_repetitions, the unit is retired: later
+    // repetitions skip it, keeping the best time it has.
+    u32* unit_stale = arena_push_array_zero(stats_scratch.a, u32, params.num_units);
+    bool adaptive_repetitions = params.stable_repetitions != 0;
+    // The values of n, in the order in which their groups are measured: first the grid, then (with
+    // grid refinement) the values that the second pass adds.
+    u32* group_ns = arena_push_array_zero(stats_scratch.a, u32, params.num_groups);
+    loop_over_ns(params, n_grid, n_grid_idx) {
+        group_ns[n_grid_idx] = n_grid;
+    }
+
+    // Time limits. We only look at the clock between units, so a unit that never returns has to be
+    // dealt with by whoever started us (see the watchdog in the GUI).
+    bool check_time = params.unit_timeout_ms != 0 || params.run_budget_s != 0;
+    u64 run_start_ms = get_ostime_ms();
+    u32 groups_valid = 0;
+
+    // The first pass measures the grid; the second, if any, the values that refine it.
+    u32 pass_groups_begin = 0;
+    u32 pass_groups_end = params.num_groups_grid;
+    u32 pass_units_begin = 0;
+    // Where the next pass's first input is sampled from. Each repetition must use the same sample,
+    // so later repetitions start each unit from where it started in the first repetition.
+    RandState rand_state_pass = {0};
+    rand_init_from_seed(&rand_state_pass, params.seed);
 
     bool aborting = false;
-    for (u32 rep = 0; rep < params.repetitions; ++rep) {
-        if (aborting) break;
+    bool out_of_budget = false;
+    for (u32 pass = 0; pass < 2; ++pass) {
+        if (aborting || out_of_budget || *result.timed_out) break;
+        if (pass == 1) {
+            if (params.refine_points == 0) break;
+            u32 added = profiler_refine_grid(
+                    params, result.groups, groups_valid, &group_ns[groups_valid],
+                    params.refine_points);
+            invocations_total -=
+                (u64)(params.refine_points - added) * (u64)sample_size * (u64)params.repetitions;
+            atomic_store_u64(result.invocations_total, invocations_total);
+            pass_groups_begin = groups_valid;
+            pass_groups_end = groups_valid + added;
+            pass_units_begin = units_next;
+        }
+        u32 num_groups_run = pass_groups_end;  // Shrinks if a unit times out.
 
-        // Each repetition must use the same sample, so we re-seed here.
-        RandState rand_state_local = {0};
-        rand_init_from_seed(&rand_state_local, params.seed);
+        for (u32 rep = 0; rep < params.repetitions; ++rep) {
+            if (aborting || out_of_budget) break;
 
-        loop_over_range_u32(params.ns, n, n_idx) {
-            if (aborting) break;
+            RandState rand_state_local = rand_state_pass;
 
-            for (u32 i = 0; i < sample_size; ++i) {
-                if (aborting) break;
+            for (u32 n_idx = pass_groups_begin; n_idx < pass_groups_end; ++n_idx) {
+                if (aborting || out_of_budget || n_idx >= num_groups_run) break;
+                u32 n = group_ns[n_idx];
 
-                if (params.separate_thread) {
-                    mutex_acquire(sync.result_mutex);
-                    if (event_check(sync.abort_event)) {
+                // Each unit's measurement is taken over a batch of inputs, which are laid out one
+                // after another; only the first is verified.
+                u64 stride = input_stride(n);
+                if (rep == 0) {
+                    plans[n_idx].batch_size = params.batch_target_us != 0
+                        ? profiler_calibrate_batch_size(
+                                params, result, input_capacity, n, rand_state_local)
+                        : 1;
+                    plans[n_idx].unit_offset = units_next;
+                    plans[n_idx].unit_count = sample_size;  // Adaptive sampling may lower this.
+                }
+                ProfilerGroupPlan plan = plans[n_idx];
+                u32 batch_size = plan.batch_size;
+
+                // Statistics over the units' best times so far, updated as each one is measured.
+                RunningStats stats = {0};
+                bool unit_timed_out = false;
+                u32 units_done = 0;
+                u32 units_next_check = sample_size_min;  // For converging on the median.
+                for (u32 i = 0; i < plan.unit_count; ++i) {
+                    if (aborting || out_of_budget || unit_timed_out) break;
+
+                    // A single (uncontended) load; we don't take any locks here.
+                    if (sync.abort_flag && atomic_load_u32(sync.abort_flag)) {
                         aborting = true;
                         continue;
                     }
-                }
 
-                ArenaTmp scratch = scratch_get(NULL, 0);
-                char* scratch_data = scratch_size
-                    ? arena_push_array(scratch.a, char, scratch_size(n))
-                    : NULL;
-                result.units[n_idx * sample_size + i].n = (f64)n;
-                result.units[n_idx * sample_size + i].seed = rand_state_local;
-
-                // Generate input data for this test unit. We do this inside the loop, just before
-                // measuring, to encourage the input data to already be in CPU cache when the
-                // critical code begins.
-                sampler(result.input, n, &rand_state_local, scratch.a);
-                if (params.verifier_enabled) {
-                    memcpy(result.input_clone, result.input, n * sizeof(*result.input));
-                }
+                    u32 unit = plan.unit_offset + i;
+                    u32* stale = &unit_stale[unit];
+                    if (adaptive_repetitions && *stale >= params.stable_repetitions) {
+                        running_stats_add(&stats, units.time[unit]);
+                        ++units_done;
+                        continue;
+                    }
 
-                // Measure the execution time of our target function.
-                u64 timer_initial = get_timer_value(params.timing);
-                target(result.input, n, &rand_state_local, scratch_data);
-                u64 timer_final = get_timer_value(params.timing);
-                u64 timer_delta = timer_final - timer_initial;
+                    u64 unit_start_ms = check_time ? get_ostime_ms() : 0;
+                    ArenaTmp scratch = scratch_get(NULL, 0);
+                    char* scratch_data = scratch_size
+                        ? arena_push_array(scratch.a, char, scratch_size(n))
+                        : NULL;
+                    if (rep == 0) {
+                        units.n[unit] = (f64)n;
+                        units.seed[unit] = rand_state_local;
+                    } else {
+                        // Units before this one may have been skipped (see unit_stale), so start
+                        // from where this unit started in the first repetition.
+                        rand_state_local = units.seed[unit];
+                    }
 
-                // Adjust for the time it takes to call the timing subroutines themselves.
-                if (params.adjust_for_timer_overhead) {
-                    if (timer_overhead < timer_delta) {
-                        timer_delta -= timer_overhead;
+                    u64 timer_delta = 0;
+                    u32 context_switches = 0;
+                    u32 page_faults = 0;
+                    for (u32 attempt = 0; ; ++attempt) {
+                        if (attempt > 0) {
+                            // Re-create the same input.
+                            rand_state_local = units.seed[unit];
+                            ++(*result.remeasurements);
+                        }
+
+                        // Generate input data for this test unit. We do this inside the loop, just
+                        // before measuring, to encourage the input data to already be in CPU cache
+                        // when the critical code begins.
+                        for (u32 j = 0; j < batch_size; ++j) {
+                            sampler(result.input + j * stride, n, &rand_state_local, scratch.a);
+                        }
+                        if (params.verifier_enabled) {
+                            memcpy(result.input_clone, result.input, n * sizeof(*result.input));
+                        }
+
+                        // Move the input and the scratch space down the cache hierarchy if asked.
+                        // (In a batch, the calls after the first find the scratch space hot.)
+                        if (params.cache_state == CACHE_COLD) {
+                            cache_flush(result.input, batch_size * stride * sizeof(u32));
+                            cache_flush(scratch_data, scratch_size ? scratch_size(n) : 0);
+                        } else if (params.cache_state == CACHE_LLC) {
+                            cache_evict_private(evict_buffer.data, evict_buffer.len);
+                        }
+
+                        // Measure the execution time of our target function. If we're watching for
+                        // disturbances, the usage counts are read outside of the timed region.
+                        ThreadUsage usage_before = {0};
+                        ThreadUsage usage_after = {0};
+                        bool watch = params.reject_disturbed && thread_get_usage(&usage_before);
+                        timer_delta = measure(
+                                target, result.input, stride, batch_size, n, &rand_state_local,
+                                scratch_data);
+                        if (!watch || !thread_get_usage(&usage_after)) {
+                            break;
+                        }
+                        context_switches =
+                            (u32)(usage_after.context_switches - usage_before.context_switches);
+                        page_faults = (u32)(usage_after.page_faults - usage_before.page_faults);
+                        if ((context_switches == 0 && page_faults == 0) ||
+                            attempt == PROFILER_DISTURBED_RETRIES_MAX) {
+                            break;
+                        }
+                    }
+
+                    // Adjust for the time it takes to call the timing subroutines themselves. (The
+                    // overhead is paid once per batch.)
+                    if (params.adjust_for_timer_overhead) {
+                        if (timer_overhead < timer_delta) {
+                            timer_delta -= timer_overhead;
+                        } else {
+                            timer_delta = 0;
+                        }
+                    }
+
+                    // Convert to wall time (unless we're counting events), per call of the target.
+                    f64 timer_delta_ns = (f64)timer_delta * timer_period_ns / batch_size;
+
+                    // Save to result data.
+                    if (params.reject_disturbed &&
+                        (rep == 0 || timer_delta_ns < units.time[unit])) {
+                        units.context_switches[unit] = context_switches;
+                        units.page_faults[unit] = page_faults;
+                    }
+                    if (rep == 0) {
+                        units.time[unit] = timer_delta_ns;
                     } else {
-                        timer_delta = 0;
+                        f64 best_so_far = units.time[unit];
+                        units.time[unit] = MIN(timer_delta_ns, best_so_far);
+                        if (adaptive_repetitions) {
+                            *stale = (timer_delta_ns < best_so_far) ? 0 : *stale + 1;
+                            if (*stale >= params.stable_repetitions) {
+                                // Retired: the remaining repetitions won't invoke the target
+                                // for it.
+                                invocations_total -= params.repetitions - 1 - rep;
+                                atomic_store_u64(result.invocations_total, invocations_total);
+                            }
+                        }
+                    }
+                    running_stats_add(&stats, units.time[unit]);
+
+                    // Verify correctness of output.
+                    if (rep == 0 && params.verifier_enabled) {
+                        if (verifier(
+                                    result.input_clone,  // Input
+                                    result.input,        // Output (was created in-place by target)
+                                    n,
+                                    &rand_state_verifier,
+                                    scratch.a)) {
+                            ++(*result.verification_accept_count);
+                        }
                     }
-                }
 
-                // Convert to wall time.
-                f64 timer_delta_ns = (f64)timer_delta * timer_period_ns;
+                    // Find how much memory the target uses, in a call of its own (the painting
+                    // would disturb the timed calls' caches). The input is re-created first, as
+                    // the target may have changed it.
+                    if (rep == 0 && params.track_memory) {
+                        RandState rand_state_memory = units.seed[unit];
+                        u64 scratch_len = scratch_size ? scratch_size(n) : 0;
+                        sampler(result.input, n, &rand_state_memory, scratch.a);
+                        scratch_paint(scratch_data, scratch_len);
+                        stack_watch(true);
+                        target(result.input, n, &rand_state_memory, scratch_data);
+                        units.stack_peak[unit] = stack_watch(false);
+                        units.scratch_peak[unit] = scratch_used(scratch_data, scratch_len);
+                    }
+                    scratch_release(scratch);
 
-                // Save to result data.
-                if (rep == 0) {
-                    result.units[n_idx * sample_size + i].time = timer_delta_ns;
-                } else {
-                    f64 best_so_far = result.units[n_idx * sample_size + i].time;
-                    result.units[n_idx * sample_size + i].time = MIN(timer_delta_ns, best_so_far);
-                }
+                    // Publish progress (and, during the first repetition, the new unit).
+                    ++invocations_completed;
+                    atomic_store_u64(result.invocations_completed, invocations_completed);
+                    if (rep == 0) {
+                        atomic_store_u32(result.units_published, plan.unit_offset + i + 1);
+                    }
+                    ++units_done;
+
+                    // Adaptive sampling: Stop taking units as soon as the mean is known well
+                    // enough. (The median takes O(units) to check, so it's checked ever more
+                    // rarely.)
+                    bool converged = false;
+                    if (rep == 0 && adaptive && units_done >= sample_size_min &&
+                        units_done < plan.unit_count) {
+                        if (!params.precision_of_median) {
+                            converged = profiler_group_converged(
+                                    stats, params.precision_pct / 100.0);
+                        } else if (units_done >= units_next_check) {
+                            converged = profiler_group_converged_median(
+                                    &units.time[plan.unit_offset], units_done, times,
+                                    params.precision_pct / 100.0);
+                            units_next_check = units_done + MAX(1u, units_done / 8);
+                        }
+                    }
+                    if (converged) {
+                        invocations_total -=
+                            (u64)(plan.unit_count - units_done) * (u64)params.repetitions;
+                        atomic_store_u64(result.invocations_total, invocations_total);
+                        plan.unit_count = units_done;
+                        plans[n_idx].unit_count = units_done;
+                    }
 
-                // Verify correctness of output.
-                if (rep == 0 && params.verifier_enabled) {
-                    if (verifier(
-                                result.input_clone,  // Input
-                                result.input,        // Output (was created in-place by target)
-                                n,
-                                &rand_state_verifier,
-                                scratch.a)) {
-                        ++(*result.verification_accept_count);
+                    if (check_time) {
+                        u64 now_ms = get_ostime_ms();
+                        // Only the first repetition decides how far n goes; later repetitions
+                        // measure the same inputs, and should take no longer.
+                        if (rep == 0 && params.unit_timeout_ms != 0 &&
+                            now_ms - unit_start_ms > params.unit_timeout_ms) {
+                            unit_timed_out = true;
+                        }
+                        if (params.run_budget_s != 0 &&
+                            now_ms - run_start_ms > 1000ull * params.run_budget_s) {
+                            out_of_budget = true;
+                        }
                     }
                 }
-                scratch_release(scratch);
 
-                ++invocations_completed;
-                *result.progress = (f32)invocations_completed / (f32)invocations_total;
-                if (params.separate_thread) {
-                    mutex_release(sync.result_mutex);
+                // Publish the group's statistics as soon as all of its units are in (again, in
+                // each repetition), so that a run which is cut short still has them.
+                if (units_done == plan.unit_count) {
+                    profiler_result_publish_group(
+                            params, result, groups_valid, plan, stats, times);
+                    if (rep == 0) {
+                        groups_valid = n_idx + 1;
+                        units_next = plan.unit_offset + plan.unit_count;
+                        atomic_store_u32(result.groups_valid, groups_valid);
+                    }
+                }
+                if (unit_timed_out) {
+                    // Stop expanding n; the remaining repetitions cover only the groups done so
+                    // far. (In the second pass, this gives up on the rest of the refinement.)
+                    num_groups_run = groups_valid;
+                    *result.timed_out = true;
+                    invocations_total =
+                        invocations_completed +
+                        (u64)(params.repetitions - 1) * (units_next - pass_units_begin);
+                    atomic_store_u64(result.invocations_total, invocations_total);
                 }
             }
-        }
-    } // for (rep ...)
-
-    // Gather result for plotting.
-    if (!aborting) {
-        if (params.separate_thread) {
-            mutex_acquire(sync.result_mutex);
-        }
-
-        ArenaTmp scratch = scratch_get(0, 0);
-        f64* times = arena_push_array_zero(scratch.a, f64, sample_size);
-        loop_over_range_u32(params.ns, n, n_idx) {
-            result.groups[n_idx].n = (f64)n;
-            result.groups[n_idx].time_mean = 0;
-            for (u32 i = 0; i < sample_size; ++i) {
-                times[i] = result.units[n_idx * sample_size + i].time;
-                result.groups[n_idx].time_mean += times[i];
-            }
-            result.groups[n_idx].time_mean /= sample_size;
-            util_sort(times, (u32)sample_size);
-            result.groups[n_idx].time_min = times[0];
-            result.groups[n_idx].time_max = times[sample_size - 1];
-            if (sample_size & 1) {
-                result.groups[n_idx].time_median = times[(sample_size - 1)/2];
-            } else {
-                result.groups[n_idx].time_median =
-                    (times[(sample_size - 1)/2] +
-                     times[(sample_size - 1)/2 + 1]) / 2;
+            if (rep == 0) {
+                rand_state_pass = rand_state_local;
             }
-        }
-        scratch_release(scratch);
-        if (params.separate_thread) {
-            mutex_release(sync.result_mutex);
-        }
+        } // for (rep ...)
+    } // for (pass ...)
+    scratch_release(stats_scratch);
+
+    if (out_of_budget) {
+        *result.timed_out = true;
+        atomic_store_u64(result.invocations_total, invocations_completed);
+    }
+    if (params.lock_memory) {
+        arena_unlock(&result.local_arena, result.local_arena.pos);
+        scratch_unlock((usize)scratch_size_max);
     }
+    arena_destroy(&evict_buffer);
+    perf_counter_close();
 }
 
 typedef struct {
@@ -682,6 +2040,8 @@ typedef struct {
     ProfilerResult result;
     HostInfo host;
     ProfilerSync sync;
+    bool pin_to_cpu;
+    u32 cpu_id;  // Logical processor to pin the worker thread to (if pin_to_cpu).
     THREAD_EVENT done_copying_args;
 } profiler_execute_args_struct;
 
@@ -692,7 +2052,48 @@ THREAD_ENTRYPOINT profiler_execute_begin(void* vargs)
     ProfilerResult result = args->result;
     HostInfo host = args->host;
     ProfilerSync sync = args->sync;
+    bool pin_to_cpu = args->pin_to_cpu;
+    u32 cpu_id = args->cpu_id;
     event_signal(args->done_copying_args);
+    if (pin_to_cpu) {
+        // Pin before the warmup, so that the boost frequency is reached on the right core. If
+        // this fails, we carry on unpinned.
+        thread_set_affinity_self(cpu_id);
+    }
     profiler_execute(params, result, host, sync);
+    // This thread is about to exit, and its scratch arenas would otherwise be leaked.
+    scratch_destroy_all();
     return 0;
 }
+
+#ifndef _WIN32
+// Execute the run in a forked child process, pinned to logical processor `cpu_id`. The result must
+// have been created for a child process (see profiler_params_in_process()), so that the child's
+// measurements reach the caller through shared memory. The caller sees the run finish when the
+// child exits; to abort the run, kill the child.
+//
+// The caller (the GUI) is multithreaded, so the child may inherit locks held by other threads at
+// the time of the fork, such as the logger's mutex or the allocator's. The child therefore must not
+// log, use stdio, or call malloc(): profiler_execute() only maps its memory with arenas, and reports
+// back through the shared result. (A failed assertion in the child is the one exception.)
+//
+// Return: the child's handle, or -1 on error.
+PROCESS profiler_execute_fork(
+        ProfilerParams params, ProfilerResult result, HostInfo host, u32 cpu_id)
+{
+    assertm(profiler_params_in_process(params), "Result memory isn't shared with the child.");
+    PROCESS child = process_fork();
+    if (child != 0) {
+        return child;
+    }
+    // We're the child. Don't hang on to the parent's scratch memory.
+    scratch_destroy_all();
+    // Pin before the warmup, so that the boost frequency is reached on the right core. If this
+    // fails, we carry on unpinned.
+    thread_set_affinity_self(cpu_id);
+    ProfilerSync sync = {0};  // Nothing to sync: the parent doesn't share the abort flag.
+    profiler_execute(params, result, host, sync);
+    process_exit(0);
+    return 0;  // Unreachable.
+}
+#endif
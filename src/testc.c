@@ -22,8 +22,22 @@
 #include "util_thread.c"
 #include "logger.c"
 #include "cpuinfo.c"
+#include "perfcounter.c"
 #include "problems/sort.c"
 #include "profiler.c"
+#include "complexity.c"
+
+
+// The number of failed checks so far; main() returns nonzero if there are any.
+u32 test_failures = 0;
+
+void test_check(bool ok, char const* what)
+{
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        ++test_failures;
+    }
+}
 
 
 void test_logger()
@@ -81,8 +95,361 @@ void test_logger()
     logger_destroy(&l);
 }
 
+void test_range_geom()
+{
+    puts("");
+    printf("Testing geometric ranges...\n");
+    range_geom_u32 ranges[] = {
+        {1, 1000000, 10},
+        {1, 100, 40},  // Many grid points round to the same integer.
+        {10, 12345, 7},
+        {3, 1000, 1},
+        {7, 7, 5},
+        {2, 3, 100},
+    };
+    for (u32 r_idx = 0; r_idx < ARRAY_SIZE(ranges); ++r_idx) {
+        range_geom_u32 r = ranges[r_idx];
+        // The expected values: the grid points r.lower * 10^(k / r.per_decade), rounded, without
+        // duplicates, and finally r.upper.
+        u32 expected[1024];
+        u32 expected_count = 0;
+        for (u32 k = 0; ; ++k) {
+            f64 value = floor(r.lower * pow(10.0, (f64)k / r.per_decade) + 0.5);
+            if (value >= (f64)r.upper) break;
+            if (expected_count == 0 || expected[expected_count - 1] != (u32)value) {
+                expected[expected_count++] = (u32)value;
+            }
+        }
+        expected[expected_count++] = r.upper;
+
+        u32 steps = 0;
+        bool matches = true;
+        u32 n = r.lower;
+        for (;;) {
+            matches = matches && steps < expected_count && n == expected[steps];
+            if (n >= r.upper) break;
+            u32 n_next = range_geom_u32_next(r, n);
+            test_check(n_next > n, "range_geom_u32_next() increases");
+            if (n_next <= n) break;
+            n = n_next;
+            ++steps;
+        }
+        printf("[%u, %u] with %u per decade: %u values.\n",
+               r.lower, r.upper, r.per_decade, steps + 1);
+        test_check(matches, "range_geom_u32_next() gives the rounded grid, without duplicates");
+        test_check(n == r.upper, "range_geom_u32_next() ends on the upper bound");
+        test_check(steps + 1 == expected_count, "range_geom_u32_next() takes every step");
+        test_check(range_geom_u32_count(r) == steps + 1,
+                   "range_geom_u32_count() counts the values of range_geom_u32_next()");
+    }
+}
+
+// Sort by insertion: slow, but obviously correct.
+void test_sort_f64(f64* data, u32 n)
+{
+    for (u32 i = 1; i < n; ++i) {
+        f64 x = data[i];
+        u32 j = i;
+        for (; j > 0 && data[j - 1] > x; --j) {
+            data[j] = data[j - 1];
+        }
+        data[j] = x;
+    }
+}
+
+bool test_close(f64 a, f64 b, f64 tolerance)
+{
+    return fabs(a - b) <= tolerance;
+}
+
+void test_statistics()
+{
+    puts("");
+    printf("Testing selection and quantiles...\n");
+    RandState rand_state;
+    rand_init_from_seed(&rand_state, 12345);
+    f64 data[1000];
+    f64 sorted[1000];
+    f64 work[1000];
+    u32 sizes[] = {1, 2, 3, 10, 101, 1000};
+    f64 quantiles[] = {0.0, 0.01, 0.25, 0.5, 0.9, 0.99, 1.0};
+    for (u32 duplicates = 0; duplicates < 2; ++duplicates) {
+        for (u32 s = 0; s < ARRAY_SIZE(sizes); ++s) {
+            u32 n = sizes[s];
+            for (u32 i = 0; i < n; ++i) {
+                // With duplicates, only a handful of distinct values.
+                data[i] = duplicates
+                    ? (f64)(rand_u32(&rand_state) % 4)
+                    : (f64)(rand_u32(&rand_state) % 1000000) / 7.0;
+            }
+            memcpy(sorted, data, n * sizeof(*data));
+            test_sort_f64(sorted, n);
+            for (u32 k = 0; k < n; ++k) {
+                memcpy(work, data, n * sizeof(*data));
+                util_select(work, n, k);
+                bool partitioned = work[k] == sorted[k];
+                for (u32 i = 0; i < n; ++i) {
+                    partitioned = partitioned &&
+                        (i < k ? work[i] <= work[k] : i > k ? work[i] >= work[k] : true);
+                }
+                test_check(partitioned, "util_select() puts the k-th smallest at k");
+            }
+            for (u32 q = 0; q < ARRAY_SIZE(quantiles); ++q) {
+                f64 h = (n - 1) * quantiles[q];
+                u32 lo = (u32)h;
+                f64 expected = lo + 1 < n
+                    ? sorted[lo] + (h - lo) * (sorted[lo + 1] - sorted[lo])
+                    : sorted[lo];
+                memcpy(work, data, n * sizeof(*data));
+                test_check(test_close(util_quantile(work, n, quantiles[q]), expected, 1e-9),
+                           "util_quantile() matches the sorted data");
+            }
+        }
+    }
+
+    printf("Testing running statistics...\n");
+    RunningStats stats = {0};
+    f64 values[] = {2, 4, 4, 4, 5, 5, 7, 9};
+    for (u32 i = 0; i < ARRAY_SIZE(values); ++i) {
+        running_stats_add(&stats, values[i]);
+    }
+    printf("Mean %f, variance %f, min %f, max %f.\n",
+           stats.mean, running_stats_variance(stats), stats.min, stats.max);
+    test_check(stats.count == 8, "running_stats_add() counts");
+    test_check(test_close(stats.mean, 5.0, 1e-12), "running_stats_add() mean");
+    test_check(test_close(running_stats_variance(stats), 32.0 / 7.0, 1e-12),
+               "running_stats_variance() is the sample variance");
+    test_check(stats.min == 2.0 && stats.max == 9.0, "running_stats_add() min and max");
+    // A large offset would ruin the naive sum-of-squares formula.
+    RunningStats offset_stats = {0};
+    f64 offset_values[] = {4, 7, 13, 16};
+    for (u32 i = 0; i < ARRAY_SIZE(offset_values); ++i) {
+        running_stats_add(&offset_stats, 1.0e9 + offset_values[i]);
+    }
+    test_check(test_close(running_stats_variance(offset_stats), 30.0, 1e-6),
+               "running_stats_variance() keeps its precision with a large mean");
+    RunningStats single_stats = {0};
+    running_stats_add(&single_stats, 3.0);
+    test_check(running_stats_variance(single_stats) == 0.0,
+               "running_stats_variance() of a single value");
+
+    printf("Testing Student's t...\n");
+    test_check(student_t_975(0) == 0.0, "student_t_975(0)");
+    test_check(test_close(student_t_975(1), 12.706, 1e-9), "student_t_975(1)");
+    test_check(test_close(student_t_975(10), 2.228, 1e-9), "student_t_975(10)");
+    test_check(test_close(student_t_975(30), 2.042, 1e-9), "student_t_975(30)");
+    test_check(test_close(student_t_975(60), 2.000, 0.002), "student_t_975(60)");
+    test_check(test_close(student_t_975(120), 1.980, 0.002), "student_t_975(120)");
+    test_check(test_close(student_t_975(100000), 1.960, 0.002), "student_t_975(100000)");
+}
+
+void test_complexity_fit()
+{
+    puts("");
+    printf("Testing complexity fits...\n");
+    RandState rand_state;
+    rand_init_from_seed(&rand_state, 54321);
+    ComplexityModelID models[] = {
+        COMPLEXITY_CONSTANT, COMPLEXITY_LINEAR, COMPLEXITY_NLOGN, COMPLEXITY_QUADRATIC,
+    };
+    range_geom_u32 ns = {10, 100000, 8};
+    ProfilerResultGroup groups[64];
+    u32 count = 0;
+    for (u32 n = ns.lower; ; n = range_geom_u32_next(ns, n)) {
+        groups[count++].n = (f64)n;
+        if (n >= ns.upper) break;
+    }
+    for (u32 noisy = 0; noisy < 2; ++noisy) {
+        for (u32 m = 0; m < ARRAY_SIZE(models); ++m) {
+            ComplexityFit truth = {0};
+            truth.model = models[m];
+            truth.a = 500.0;
+            truth.b = 0.25;
+            for (u32 i = 0; i < count; ++i) {
+                f64 t = complexity_evaluate(truth, groups[i].n);
+                if (noisy) {
+                    // Up to 2% either way.
+                    t *= 1.0 + 0.02 * ((f64)(rand_u32(&rand_state) % 2001) / 1000.0 - 1.0);
+                }
+                groups[i].time_median = t;
+            }
+            for (u32 allow_power = 0; allow_power < 2; ++allow_power) {
+                ComplexityFit fit = complexity_fit_best(groups, count, allow_power);
+                char description[128];
+                complexity_fit_describe(fit, description, sizeof(description));
+                printf("%s%s, %s: %s\n",
+                       complexity_models[models[m]].name_long,
+                       noisy ? " with noise" : "",
+                       allow_power ? "power allowed" : "basic models",
+                       description);
+                test_check(fit.valid && fit.model == models[m],
+                           "complexity_fit_best() picks the model the data came from");
+            }
+        }
+    }
+    ComplexityFit fit = complexity_fit_best(groups, 2, true);
+    test_check(fit.valid && fit.model == COMPLEXITY_CONSTANT,
+               "complexity_fit_best() falls back to the constant with too few points");
+    test_check(!complexity_fit_best(groups, 0, true).valid,
+               "complexity_fit_best() fits nothing to no points");
+}
+
+// Check that the values of n from profiler_refine_grid() are new: distinct, strictly between the
+// lowest and highest existing n, and not any of the existing ones.
+bool test_refined_ns_new(ProfilerResultGroup const* groups, u32 count, u32 const* ns_new, u32 added)
+{
+    for (u32 i = 0; i < added; ++i) {
+        if (ns_new[i] <= groups[0].n || ns_new[i] >= groups[count - 1].n) {
+            return false;
+        }
+        for (u32 j = 0; j < count; ++j) {
+            if (ns_new[i] == groups[j].n) return false;
+        }
+        for (u32 j = 0; j < i; ++j) {
+            if (ns_new[i] == ns_new[j]) return false;
+        }
+    }
+    return true;
+}
+
+void test_refine_grid()
+{
+    puts("");
+    printf("Testing grid refinement...\n");
+    ProfilerParams params = profiler_params_default();
+    ProfilerResultGroup groups[16] = {{0}};
+    u32 ns_new[64];
+
+    // Arithmetic: the time per element jumps tenfold at n = 50.
+    params.ns_kind = RANGE_ARITHMETIC;
+    u32 count = 11;
+    for (u32 i = 0; i < count; ++i) {
+        groups[i].n = 10.0 * i;
+        groups[i].time_median = groups[i].n <= 50 ? groups[i].n : 500 + 10 * (groups[i].n - 50);
+    }
+    u32 added = profiler_refine_grid(params, groups, count, ns_new, 4);
+    printf("Knee at 50, on [0, 100] by 10: first new n is %u.\n", added ? ns_new[0] : 0);
+    test_check(added == 4, "profiler_refine_grid() adds as many values as asked");
+    test_check(added > 0 && (ns_new[0] == 45 || ns_new[0] == 55),
+               "profiler_refine_grid() refines at the knee first");
+    test_check(test_refined_ns_new(groups, count, ns_new, added),
+               "profiler_refine_grid() adds only new values");
+
+    // Geometric: a straight line on the log-log plot, until it steepens at n = 1000.
+    params.ns_kind = RANGE_GEOMETRIC;
+    count = 5;
+    for (u32 i = 0; i < count; ++i) {
+        groups[i].n = pow(10.0, i + 1);
+        groups[i].time_median = groups[i].n <= 1000
+            ? groups[i].n
+            : 1000 * pow(groups[i].n / 1000, 3.0);
+    }
+    added = profiler_refine_grid(params, groups, count, ns_new, 2);
+    printf("Knee at 1000, on [10, 100000] by decades: new n are %u and %u.\n",
+           added > 0 ? ns_new[0] : 0, added > 1 ? ns_new[1] : 0);
+    test_check(added == 2 &&
+               ((ns_new[0] == 316 && ns_new[1] == 3162) || (ns_new[0] == 3162 && ns_new[1] == 316)),
+               "profiler_refine_grid() splits the intervals on either side of the knee");
+    test_check(test_refined_ns_new(groups, count, ns_new, added),
+               "profiler_refine_grid() adds only new values");
+
+    // There's no room left between consecutive integers.
+    params.ns_kind = RANGE_ARITHMETIC;
+    u32 tight_ns[] = {1, 3, 4, 5};
+    count = ARRAY_SIZE(tight_ns);
+    for (u32 i = 0; i < count; ++i) {
+        groups[i].n = tight_ns[i];
+        groups[i].time_median = tight_ns[i] * tight_ns[i];
+    }
+    added = profiler_refine_grid(params, groups, count, ns_new, 10);
+    test_check(added == 1 && ns_new[0] == 2,
+               "profiler_refine_grid() doesn't repeat existing values of n");
+    added = profiler_refine_grid(params, groups + 1, count - 1, ns_new, 10);
+    test_check(added == 0, "profiler_refine_grid() adds nothing to consecutive values of n");
+    test_check(profiler_refine_grid(params, groups, 1, ns_new, 10) == 0,
+               "profiler_refine_grid() needs two values of n");
+}
+
+void test_arena_growable()
+{
+    puts("");
+    printf("Testing growable arenas...\n");
+    usize const granularity = ARENA_COMMIT_GRANULARITY;
+    Arena a = arena_create_growable(4 * granularity - 100);
+    test_check(a.data && a.reserved == 4 * granularity && a.len == 0 && a.pos == 0,
+               "arena_create_growable() reserves whole chunks, and commits nothing");
+
+    // Growing commits whole chunks, as needed.
+    test_check(arena_ensure(&a, 100) && a.len == granularity,
+               "arena_ensure() commits a chunk");
+    byte* small = arena_push(&a, 100);
+    test_check(small == a.data && a.pos == 100, "arena_push() onto a growable arena");
+    memset(small, 1, 100);
+    byte* large = arena_push_zero(&a, granularity + 1);
+    test_check(large == a.data + 100 && a.len == 2 * granularity,
+               "arena_push_zero() commits what it needs");
+    large[granularity] = 1;  // Committed, so this mustn't crash.
+    test_check(!arena_ensure(&a, 4 * granularity) && a.len == 2 * granularity,
+               "arena_ensure() fails beyond the reserved space");
+    printf("Reserved %zu bytes, committed %zu, used %zu.\n", a.reserved, a.len, a.pos);
+
+    // Memory beyond the position is returned, and comes back zeroed.
+    test_check(arena_pop(&a, granularity + 1, NULL) && arena_decommit(&a) && a.len == granularity,
+               "arena_decommit() returns what's beyond the position");
+    test_check(small[99] == 1, "arena_decommit() keeps what's before the position");
+    large = arena_push(&a, granularity + 1);
+    test_check(a.len == 2 * granularity && large[granularity] == 0,
+               "A decommitted growable arena commits zeroed memory again");
+    arena_clear_decommit(&a);
+    test_check(a.len == 0 && a.pos == 0, "arena_clear_decommit() returns everything");
+
+    // A dynamic array at the top of the arena grows where it is.
+    darray_u32 vec = darray_u32_new(&a, 4);
+    u32* vec_data = vec.data;
+    for (u32 i = 0; i < 10000; ++i) {
+        *darray_u32_push(&a, &vec) = i;
+    }
+    bool vec_ok = vec.len == 10000;
+    for (u32 i = 0; i < vec.len; ++i) {
+        vec_ok = vec_ok && vec.data[i] == i;
+    }
+    test_check(vec_ok, "darray_push() keeps the elements");
+    test_check(vec.data == vec_data && a.pos == vec.cap * sizeof(u32),
+               "darray_push() grows in place at the top of the arena");
+    // Once something else is on top, it has to move.
+    arena_push(&a, 1);
+    u32 cap_in_place = (u32)vec.cap;
+    for (u32 i = (u32)vec.len; i <= cap_in_place; ++i) {
+        *darray_u32_push(&a, &vec) = i;
+    }
+    test_check(vec.data != vec_data &&
+               vec.data[1234] == 1234 &&
+               vec.data[vec.len - 1] == vec.len - 1,
+               "darray_push() moves the array when it's not at the top of the arena");
+    arena_destroy(&a);
+
+    // A fixed-size arena never grows.
+    Arena fixed = arena_create(granularity);
+    usize fixed_len = fixed.len;
+    arena_push(&fixed, fixed_len);
+    test_check(fixed.reserved == 0 && !arena_ensure(&fixed, 1) && fixed.len == fixed_len,
+               "arena_ensure() fails on a full fixed-size arena");
+    test_check(!arena_decommit(&fixed) && fixed.len == fixed_len,
+               "arena_decommit() leaves a fixed-size arena alone");
+    arena_destroy(&fixed);
+}
+
 int main()
 {
     test_logger();
+    test_range_geom();
+    test_statistics();
+    test_complexity_fit();
+    test_refine_grid();
+    test_arena_growable();
+    if (test_failures > 0) {
+        printf("\n%u checks FAILED.\n", test_failures);
+        return 1;
+    }
     return 0;
 }
@@ -6,6 +6,7 @@
 #endif
 
 #include <assert.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -24,7 +25,9 @@
   #include <intrin.h>
 #else
   #include <errno.h>
+  #include <linux/mempolicy.h>
   #include <sys/mman.h>
+  #include <sys/syscall.h>
   #include <sys/time.h>
   #include <time.h>
   #include <unistd.h>
@@ -87,6 +90,10 @@ typedef struct { T lower; T upper; T stride; } range_##T;
 FOR_INTEGER_TYPES
 #undef X
 
+// A geometric range: the values lower * 10^(k / per_decade) for k = 0, 1, 2, ..., rounded to
+// integers (skipping repeats), up to upper, which is always the last value.
+typedef struct { u32 lower; u32 upper; u32 per_decade; } range_geom_u32;
+
 typedef struct
 {
     u16 year; // e.g., 2025
@@ -122,6 +129,22 @@ Timedate get_timedate();
   #define NEVER_INLINE  // Fallback for unknown compilers
 #endif
 
+// Inline even in unoptimized builds. Use sparingly: only where the cost of a call is measurable.
+#if defined(_MSC_VER)
+  #define ALWAYS_INLINE __forceinline  // MSVC
+#elif defined(__GNUC__) || defined(__clang__)
+  #define ALWAYS_INLINE inline __attribute__((always_inline))  // GCC/Clang
+#else
+  #define ALWAYS_INLINE inline  // Fallback for unknown compilers
+#endif
+
+// Storage class for variables with one instance per thread.
+#if defined(_MSC_VER)
+  #define THREAD_LOCAL __declspec(thread)
+#else
+  #define THREAD_LOCAL __thread
+#endif
+
 // Size of a static array.
 #define ARRAY_SIZE(_ARR) ((usize)(sizeof(_ARR) / sizeof(*(_ARR))))
 
@@ -163,6 +186,41 @@ void range_##T##_clamp(range_##T * r, T min, T max)                     \
 FOR_INTEGER_TYPES
 #undef X
 
+// Return the value that follows n in the geometric range (n must be in the range, but not last).
+u32 range_geom_u32_next(range_geom_u32 r, u32 n)
+{
+    // Start the search a little below where n falls on the grid, in case of rounding errors.
+    f64 steps = r.per_decade * log10((f64)n / r.lower);
+    f64 k = MAX(0.0, floor(steps) - 1.0);
+    for (;; k += 1.0) {
+        f64 value = floor(r.lower * pow(10.0, k / r.per_decade) + 0.5);
+        if (value >= (f64)r.upper) {
+            return r.upper;
+        }
+        if (value > (f64)n) {
+            return (u32)value;
+        }
+    }
+}
+
+u32 range_geom_u32_count(range_geom_u32 r)
+{
+    u32 count = 1;
+    for (u32 n = r.lower; n < r.upper; n = range_geom_u32_next(r, n)) {
+        ++count;
+    }
+    return count;
+}
+
+void range_geom_u32_repair(range_geom_u32* r)
+{
+    r->lower = MAX(1u, r->lower);
+    r->per_decade = MAX(1u, r->per_decade);
+    if (r->lower > r->upper) {
+        r->upper = r->lower;
+    }
+}
+
 #define loop_over_range_u32(_r, _n, _n_idx)     \
     u32 (_n_idx) = 0;                           \
     u32 (_n);                                   \
@@ -232,6 +290,130 @@ void util_sort(f64* data, u32 n)
     } while (n > 1);
 }
 
+// Floyd-Rivest selection on data[left .. right] (inclusive).
+static void util_select_range(f64* data, i64 left, i64 right, i64 k)
+{
+    while (right > left) {
+        if (right - left > 600) {
+            // Recurse on a small sample around k, to find pivots that are very likely to bracket
+            // the k-th element closely; then the partition below discards most of the array.
+            f64 count = (f64)(right - left + 1);
+            f64 i = (f64)(k - left + 1);
+            f64 z = log(count);
+            f64 s = 0.5 * exp(2.0 * z / 3.0);
+            f64 sd = 0.5 * sqrt(z * s * (count - s) / count) * (i < count / 2 ? -1.0 : 1.0);
+            i64 new_left = MAX(left, (i64)floor((f64)k - i * s / count + sd));
+            i64 new_right = MIN(right, (i64)floor((f64)k + (count - i) * s / count + sd));
+            util_select_range(data, new_left, new_right, k);
+        }
+        // Partition around t = data[k].
+        f64 t = data[k];
+        i64 i = left;
+        i64 j = right;
+        { SWAP_f64(data[left], data[k]); }
+        if (data[right] > t) {
+            SWAP_f64(data[right], data[left]);
+        }
+        while (i < j) {
+            SWAP_f64(data[i], data[j]);
+            ++i;
+            --j;
+            while (data[i] < t) ++i;
+            while (data[j] > t) --j;
+        }
+        if (data[left] == t) {
+            SWAP_f64(data[left], data[j]);
+        } else {
+            ++j;
+            SWAP_f64(data[j], data[right]);
+        }
+        // Continue on whichever side holds k.
+        if (j <= k) left = j + 1;
+        if (k <= j) right = j - 1;
+    }
+}
+
+// Selection: Rearrange the array so that data[k] is the element that would be there if the array
+// were sorted, with no larger elements before it and no smaller ones after it. Expected linear
+// time. In-place.
+void util_select(f64* data, u32 n, u32 k)
+{
+    if (k >= n) return;
+    util_select_range(data, 0, (i64)n - 1, (i64)k);
+}
+
+// Return the q-th quantile (0 <= q <= 1) of the data, interpolating linearly between neighbouring
+// elements (so, q = 0.5 gives the usual median). Rearranges the array, as util_select().
+f64 util_quantile(f64* data, u32 n, f64 q)
+{
+    if (n == 0) return 0.0;
+    f64 h = (f64)(n - 1) * CLAMP(q, 0.0, 1.0);
+    u32 lo = (u32)h;
+    util_select(data, n, lo);
+    f64 frac = h - (f64)lo;
+    if (frac == 0.0 || lo + 1 >= n) {
+        return data[lo];
+    }
+    // The next element up is the smallest of those after data[lo].
+    f64 next = data[lo + 1];
+    for (u32 i = lo + 2; i < n; ++i) {
+        next = MIN(next, data[i]);
+    }
+    return data[lo] + frac * (next - data[lo]);
+}
+
+// Running statistics (Welford's algorithm): values are added one at a time, and the mean and
+// variance are always up to date, without storing the values and without the loss of precision of
+// the naive sum-of-squares formula.
+typedef struct
+{
+    u32 count;
+    f64 mean;
+    f64 m2;  // Sum of squared deviations from the mean.
+    f64 min;
+    f64 max;
+} RunningStats;
+
+void running_stats_add(RunningStats* s, f64 x)
+{
+    if (s->count == 0) {
+        s->min = x;
+        s->max = x;
+    } else {
+        s->min = MIN(s->min, x);
+        s->max = MAX(s->max, x);
+    }
+    ++s->count;
+    f64 delta = x - s->mean;
+    s->mean += delta / s->count;
+    s->m2 += delta * (x - s->mean);
+}
+
+// Sample variance (with Bessel's correction); zero for fewer than two values.
+f64 running_stats_variance(RunningStats s)
+{
+    return s.count < 2 ? 0.0 : s.m2 / (s.count - 1);
+}
+
+// The 97.5th percentile of Student's t-distribution with the given degrees of freedom: the
+// multiplier for a two-sided 95% confidence interval.
+f64 student_t_975(u32 df)
+{
+    static f64 const table[30] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+         2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+         2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+    if (df == 0) {
+        return 0.0;
+    }
+    if (df <= 30) {
+        return table[df - 1];
+    }
+    // Beyond the table, this is within 0.002 of the true value.
+    return 1.960 + 2.5 / df;
+}
+
 
 /**************** Random numbers ****************/
 
@@ -479,33 +661,88 @@ u32 print_timedate(u8* buf, u32 buf_len, Timedate td, bool bracketed)
 
 /**************** Memory management ****************/
 
-// Simple, fixed-size, stack-type arena (aka bump allocator).
+// Simple, stack-type arena (aka bump allocator). An arena is either fixed-size, with all of its
+// memory committed up front, or growable (see arena_create_growable()), in which case it reserves
+// a large range of address space and commits pages only as they're pushed onto.
+
+// What kind of pages back an arena's memory. Huge pages cut down on TLB misses when large buffers
+// are accessed all over; the kinds are in order of preference, so the weaker of two is the MIN.
+typedef enum
+{
+    HUGE_PAGES_NONE,
+    HUGE_PAGES_TRANSPARENT,  // Linux: ask for transparent huge pages, with madvise(MADV_HUGEPAGE).
+    HUGE_PAGES_EXPLICIT,     // Linux: map from the pool of reserved huge pages, with MAP_HUGETLB.
+    HUGE_PAGES_ID_MAX
+} HugePagesID;
+
+typedef struct
+{
+    char const* name_short;  // For the command line.
+    char const* name_long;
+} HugePagesKind;
+
+static HugePagesKind huge_pages_kinds[HUGE_PAGES_ID_MAX] =
+{
+    { "off",         "Off" },
+    { "transparent", "Transparent (madvise)" },
+    { "explicit",    "Explicit (hugetlbfs)" },
+};
+
+// The size of a huge page: the default on x86-64 Linux.
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
 
 typedef struct
 {
     byte* data;
-    usize len;
+    usize len;  // Bytes committed (usable without growing).
     usize pos;
+    usize reserved;  // Growable arenas only (0 otherwise): bytes of address space set aside.
+    HugePagesID huge_pages;  // What was actually granted (see arena_create_huge()).
+    HugePagesID huge_pages_requested;  // What was asked for (which may be more than was granted).
 } Arena;
 
+// Growable arenas commit memory in chunks of this many bytes (a multiple of the page size).
+#define ARENA_COMMIT_GRANULARITY (64 * 1024)
+
 typedef struct
 {
     Arena* a;
     usize pos_saved;
 } ArenaTmp;
 
-// Create a fixed-size Arena. Commit all memory immediately. The parameter `initial_size` (in bytes)
-// must be nonzero.
-//
-// Return: Arena on success; stub (all-0) on error.
-//
-Arena arena_create(usize initial_size)
+#ifndef _WIN32
+// Return true if the kernel may back shared anonymous memory with transparent huge pages when asked
+// to with madvise(). (For private memory, madvise() itself fails if it may not.)
+static bool thp_shared_memory_enabled()
+{
+    FILE* f = fopen("/sys/kernel/mm/transparent_hugepage/shmem_enabled", "r");
+    if (!f) {
+        return false;
+    }
+    char buf[128] = {0};
+    usize len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+    // The setting in effect is in brackets, e.g.: "always within_size [advise] never deny force"
+    char const* setting = strchr(buf, '[');
+    return setting &&
+        (strncmp(setting, "[always]", 8) == 0 ||
+         strncmp(setting, "[within_size]", 13) == 0 ||
+         strncmp(setting, "[advise]", 8) == 0 ||
+         strncmp(setting, "[force]", 7) == 0);
+}
+#endif
+
+// Map `initial_size` bytes for an Arena (see arena_create(), arena_create_shared(), and
+// arena_create_huge()).
+static Arena arena_create_mapping(usize initial_size, bool shared, HugePagesID huge_pages)
 {
     Arena a = {0};
     if (initial_size == 0) {
         assertm(false, "Cannot create an empty arena.");
         return a;
     }
+    HugePagesID huge_pages_requested = huge_pages;
     byte* data = NULL;
   #ifdef _WIN32
     data = (byte*) VirtualAlloc(
@@ -515,31 +752,191 @@ Arena arena_create(usize initial_size)
             PAGE_READWRITE
         );
     bool success = data != NULL;
+    (void)shared;
+    huge_pages = HUGE_PAGES_NONE;
+  #else
+    i32 flags = (shared ? MAP_SHARED : MAP_PRIVATE) | MAP_ANONYMOUS;
+    bool success = false;
+    if (huge_pages == HUGE_PAGES_EXPLICIT) {
+        // The length must be a whole number of huge pages. This fails if the pool of huge pages
+        // (see /proc/sys/vm/nr_hugepages) is too small, in which case we fall back.
+        usize len = HUGE_PAGE_SIZE * ((initial_size-1) / HUGE_PAGE_SIZE + 1);
+        data = (byte*)mmap(NULL, len, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+        success = data != MAP_FAILED;
+        if (success) {
+            initial_size = len;
+        } else {
+            huge_pages = HUGE_PAGES_TRANSPARENT;
+        }
+    }
+    if (!success && huge_pages == HUGE_PAGES_TRANSPARENT) {
+        // Transparent huge pages can only back aligned runs of HUGE_PAGE_SIZE bytes, so map a
+        // little extra, and trim the mapping to the alignment.
+        usize len = HUGE_PAGE_SIZE * ((initial_size-1) / HUGE_PAGE_SIZE + 1);
+        data = (byte*)mmap(NULL, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
+        success = data != MAP_FAILED;
+        if (success) {
+            usize head = (HUGE_PAGE_SIZE - (usize)data % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+            byte* aligned = data + head;
+            if (head != 0) {
+                munmap(data, head);
+            }
+            munmap(aligned + len, HUGE_PAGE_SIZE - head);
+            data = aligned;
+            initial_size = len;
+            if (0 != madvise(data, len, MADV_HUGEPAGE) ||
+                (shared && !thp_shared_memory_enabled())) {
+                huge_pages = HUGE_PAGES_NONE;  // The kernel won't use transparent huge pages here.
+            }
+        }
+    }
+    if (!success) {
+        // On some systems, munmap() requires the length to be a multiple of the page size, so
+        // we round it up to the nearest multiple.
+        usize page_size = sysconf(_SC_PAGESIZE);
+        initial_size = page_size * ((initial_size-1) / page_size + 1);
+        data = (byte*)mmap(NULL, initial_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+        success = data != MAP_FAILED;
+        huge_pages = HUGE_PAGES_NONE;
+    }
+  #endif
+    if (success) {
+        a.len = initial_size;
+        a.pos = 0;
+        a.data = data;
+        a.huge_pages = huge_pages;
+        a.huge_pages_requested = huge_pages_requested;
+    } else {
+        // Nothing to do (a is already a stub).
+    }
+    return a;
+}
+
+// Create a fixed-size Arena. Commit all memory immediately. The parameter `initial_size` (in bytes)
+// must be nonzero.
+//
+// Return: Arena on success; stub (all-0) on error.
+//
+Arena arena_create(usize initial_size)
+{
+    return arena_create_mapping(initial_size, false, HUGE_PAGES_NONE);
+}
+
+// Like arena_create(), but the memory stays shared with any child process forked afterwards, rather
+// than being copied on write: writes by the child are seen by the parent, and vice-versa. On
+// Windows, where we don't fork, this is the same as arena_create().
+Arena arena_create_shared(usize initial_size)
+{
+    return arena_create_mapping(initial_size, true, HUGE_PAGES_NONE);
+}
+
+// Like arena_create() (or arena_create_shared(), if `shared` is set), but try to back the memory
+// with huge pages. If the requested kind isn't available, fall back to the next kind (explicit,
+// then transparent, then none); the arena's `huge_pages` says what it got. Transparent huge pages
+// are only a request: the kernel may still use small pages for some or all of the memory.
+Arena arena_create_huge(usize initial_size, bool shared, HugePagesID huge_pages)
+{
+    return arena_create_mapping(initial_size, shared, huge_pages);
+}
+
+// Create a growable Arena: Reserve `reserve_size` bytes of address space (which must be nonzero),
+// but commit none of it; memory is committed as it's pushed onto, so the resident footprint
+// follows actual use. Reserving costs no memory, so `reserve_size` may be generous. Pointers into
+// the arena stay valid as it grows.
+//
+// Return: Arena on success; stub (all-0) on error.
+//
+Arena arena_create_growable(usize reserve_size)
+{
+    Arena a = {0};
+    if (reserve_size == 0) {
+        assertm(false, "Cannot create an empty arena.");
+        return a;
+    }
+    reserve_size = ARENA_COMMIT_GRANULARITY *
+        ((reserve_size - 1) / ARENA_COMMIT_GRANULARITY + 1);
+    byte* data = NULL;
+  #ifdef _WIN32
+    data = (byte*) VirtualAlloc(NULL, reserve_size, MEM_RESERVE, PAGE_NOACCESS);
+    bool success = data != NULL;
   #else
-    // On some systems, munmap() requires the length to be a multiple of the page size, so
-    // we round it up to the nearest multiple.
-    usize page_size = sysconf(_SC_PAGESIZE);
-    initial_size = page_size * ((initial_size-1) / page_size + 1);
     data = (byte*)mmap(
             NULL,
-            initial_size,
-            PROT_READ | PROT_WRITE,
-            MAP_PRIVATE | MAP_ANONYMOUS,
+            reserve_size,
+            PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
             -1,
             0
         );
     bool success = data != MAP_FAILED;
   #endif
     if (success) {
-        a.len = initial_size;
-        a.pos = 0;
         a.data = data;
-    } else {
-        // Nothing to do (a is already a stub).
+        a.len = 0;
+        a.pos = 0;
+        a.reserved = reserve_size;
     }
     return a;
 }
 
+// Make sure that `len` more bytes fit in the arena, committing more memory if it's growable.
+//
+// Return: true on success; false if the arena is full (or out of memory).
+//
+static bool arena_ensure(Arena* a, usize len)
+{
+    if (len <= a->len - a->pos) {
+        return true;
+    }
+    if (a->reserved == 0) {
+        return false;  // Fixed-size, and full.
+    }
+    if (len > a->reserved - a->pos) {
+        return false;  // Out of reserved address space.
+    }
+    usize len_new = ARENA_COMMIT_GRANULARITY *
+        ((a->pos + len - 1) / ARENA_COMMIT_GRANULARITY + 1);
+    len_new = MIN(len_new, a->reserved);
+  #ifdef _WIN32
+    bool success = NULL != VirtualAlloc(
+            a->data + a->len, len_new - a->len, MEM_COMMIT, PAGE_READWRITE);
+  #else
+    bool success = 0 == mprotect(a->data + a->len, len_new - a->len, PROT_READ | PROT_WRITE);
+  #endif
+    if (success) {
+        a->len = len_new;
+    }
+    return success;
+}
+
+// Return committed memory that lies beyond the arena's current position to the OS. (The memory is
+// committed again, zeroed, if the arena grows back into it.) Fixed-size arenas are left alone.
+//
+// Return: true on success; false on error.
+//
+bool arena_decommit(Arena* a)
+{
+    if (!a->data || a->reserved == 0) {
+        return false;
+    }
+    usize len_new = ARENA_COMMIT_GRANULARITY *
+        ((a->pos + ARENA_COMMIT_GRANULARITY - 1) / ARENA_COMMIT_GRANULARITY);
+    if (len_new >= a->len) {
+        return true;
+    }
+  #ifdef _WIN32
+    bool success = VirtualFree(a->data + len_new, a->len - len_new, MEM_DECOMMIT);
+  #else
+    bool success =
+        0 == madvise(a->data + len_new, a->len - len_new, MADV_DONTNEED) &&
+        0 == mprotect(a->data + len_new, a->len - len_new, PROT_NONE);
+  #endif
+    if (success) {
+        a->len = len_new;
+    }
+    return success;
+}
+
 // Release the Arena, i.e., deallocate its memory. If Arena was already released, do nothing.
 //
 // Return: true on success; false on error.
@@ -552,22 +949,140 @@ bool arena_destroy(Arena* a)
   #ifdef _WIN32
     bool success = VirtualFree(a->data, 0, MEM_RELEASE);
   #else
-    bool success = 0 == munmap(a->data, a->len);
+    bool success = 0 == munmap(a->data, a->reserved != 0 ? a->reserved : a->len);
   #endif
     if (success) {
         a->data = 0;
         a->len = 0;
         a->pos = 0;
+        a->reserved = 0;
+        a->huge_pages = HUGE_PAGES_NONE;
+        a->huge_pages_requested = HUGE_PAGES_NONE;
     }
     return success;
 }
 
+// Make the Arena's memory read-only for the calling process; any later write will crash. Another
+// process sharing the memory (see arena_create_shared()) may still write to it.
+//
+// Return: true on success; false on error.
+//
+bool arena_set_readonly(Arena* a)
+{
+    if (!a->data) {
+        return false;
+    }
+  #ifdef _WIN32
+    DWORD protect_old = 0;
+    return VirtualProtect(a->data, a->len, PAGE_READONLY, &protect_old);
+  #else
+    return 0 == mprotect(a->data, a->len, PROT_READ);
+  #endif
+}
+
+// Touch every page of the first `len` bytes of the Arena's committed memory, without changing its
+// contents, so that none of it page-faults when it's used later. If `lock` is set, also lock the
+// pages into RAM (see mlock(2)), so that they can't be paged out until arena_unlock().
+//
+// Return: true on success; false if the pages couldn't be locked (e.g., beyond RLIMIT_MEMLOCK, see
+// `ulimit -l`), in which case they've still been touched.
+//
+#define ARENA_PREFAULT_STRIDE 4096  // The smallest page size there is.
+bool arena_prefault(Arena* a, usize len, bool lock)
+{
+    len = MIN(len, a->len);
+    if (!a->data || len == 0) {
+        return true;
+    }
+    // A write is what maps a private page for good (a read may just map the shared zero page).
+    byte volatile* data = a->data;
+    for (usize i = 0; i < len; i += ARENA_PREFAULT_STRIDE) {
+        data[i] = data[i];
+    }
+    data[len - 1] = data[len - 1];
+    if (!lock) {
+        return true;
+    }
+  #ifdef _WIN32
+    return VirtualLock(a->data, len);
+  #else
+    return 0 == mlock(a->data, len);
+  #endif
+}
+
+// Undo the locking done by arena_prefault().
+void arena_unlock(Arena* a, usize len)
+{
+    len = MIN(len, a->len);
+    if (!a->data || len == 0) {
+        return;
+    }
+  #ifdef _WIN32
+    VirtualUnlock(a->data, len);
+  #else
+    munlock(a->data, len);
+  #endif
+}
+
+// Bind the first `len` bytes of the Arena's committed memory to the given NUMA node, so that its
+// pages are allocated there, and move those already allocated elsewhere (see mbind(2)). Pages that
+// are also mapped by another process (e.g., shared memory that was touched before a fork) stay
+// where they are. Linux only.
+//
+// Return: true on success; false if there's no such node, or on any other error.
+//
+bool arena_bind_numa_node(Arena* a, usize len, u32 node)
+{
+  #ifdef _WIN32
+    (void)a; (void)len; (void)node;
+    return false;
+  #else
+    len = MIN(len, a->len);
+    if (!a->data || len == 0) {
+        return true;
+    }
+    unsigned long mask = 0;
+    if (node >= 8 * sizeof(mask)) {
+        return false;
+    }
+    mask = 1ul << node;
+    // The kernel reads one bit fewer than `maxnode` says (see the BUGS in mbind(2)).
+    return 0 == syscall(
+            SYS_mbind, a->data, len, MPOL_BIND, &mask, 8 * sizeof(mask) + 1, MPOL_MF_MOVE);
+  #endif
+}
+
+// Return the NUMA node holding the page at the given address, or -1 if it's unknown (or not yet
+// allocated). Linux only.
+i32 numa_node_of_address(void const* addr)
+{
+  #ifdef _WIN32
+    (void)addr;
+    return -1;
+  #else
+    int node = -1;
+    if (0 != syscall(SYS_get_mempolicy, &node, NULL, 0, addr, MPOL_F_NODE | MPOL_F_ADDR)) {
+        return -1;
+    }
+    return (i32)node;
+  #endif
+}
+
 // Reset the Arena to empty. Do not deallocate/decommit any memory.
 void arena_clear(Arena* a)
 {
     a->pos = 0;
 }
 
+// Reset the Arena to empty, and if it's growable, decommit all of its memory.
+void arena_clear_decommit(Arena* a)
+{
+    a->pos = 0;
+    if (a->reserved != 0) {
+        arena_decommit(a);
+    }
+}
+
 // Return a temporary (sub-lifetime) arena, built on top of an existing Arena. No new memory is
 // allocated.
 ArenaTmp arena_tmp_begin(Arena* a)
@@ -598,16 +1113,21 @@ void arena_tmp_end(ArenaTmp tmp)
 //
 // Returns a stub if there are no available scratch arenas.
 //
-// Warning: Scratch arenas are not thread-safe! Do not request a scratch arena from two
-// threads simultaneously.
+// Each thread has its own set of scratch arenas, so they may be used by several threads at once.
+// A scratch arena must not be passed to (or used by) any thread other than the one that got it.
+// The arenas are created lazily with size SCRATCH_ARENA_SIZE, unless scratch_reserve() has been
+// called first. A thread that uses scratch arenas should call scratch_destroy_all() before it
+// exits; otherwise, their memory is leaked.
 //
 // Source: https://www.rfleury.com/p/untangling-lifetimes-the-arena-allocator
 //
 #define MAX_SCRATCH_ARENAS 2
 #define SCRATCH_ARENA_SIZE (8 * 1024 * 1024)
+static THREAD_LOCAL Arena scratch_arenas[MAX_SCRATCH_ARENAS] = {0};
+
 ArenaTmp scratch_get(Arena** conflicts, usize conflict_count)
 {
-    static Arena scratch[MAX_SCRATCH_ARENAS] = {0};
+    Arena* scratch = scratch_arenas;  // For brevity.
     bool does_conflict[MAX_SCRATCH_ARENAS] = {0};
     for (usize i = 0; i < conflict_count; ++i) {
         for (usize j = 0; j < MAX_SCRATCH_ARENAS; ++j) {
@@ -619,8 +1139,7 @@ ArenaTmp scratch_get(Arena** conflicts, usize conflict_count)
     for (usize j = 0; j < MAX_SCRATCH_ARENAS; ++j) {
         if (!does_conflict[j]) {
             if (!scratch[j].data) {
-                Arena new_arena = arena_create(SCRATCH_ARENA_SIZE);
-                memcpy(&scratch, &new_arena, sizeof new_arena);
+                scratch[j] = arena_create(SCRATCH_ARENA_SIZE);
             }
             return arena_tmp_begin(&scratch[j]);
         }
@@ -629,6 +1148,78 @@ ArenaTmp scratch_get(Arena** conflicts, usize conflict_count)
     ArenaTmp empty_arena_tmp = {0};
     return empty_arena_tmp;
 }
+
+// Make sure that each of the calling thread's scratch arenas can hold at least `len` bytes, and was
+// created asking for the given kind of pages (see arena_create_huge()). Arenas that are too small,
+// or were created asking for other pages, are re-created, so this must not be called while any of
+// them are in use. (An arena that asked for huge pages and fell back is kept as it is.) If
+// `huge_pages_granted` isn't NULL, it's set to the weakest kind of pages that the arenas got.
+//
+// Return: true on success; false on error (out of memory, or an arena is in use).
+//
+bool scratch_reserve(usize len, HugePagesID huge_pages, HugePagesID* huge_pages_granted)
+{
+    HugePagesID granted = huge_pages;
+    for (usize j = 0; j < MAX_SCRATCH_ARENAS; ++j) {
+        Arena* scratch = &scratch_arenas[j];
+        if (!(scratch->data && scratch->len >= len &&
+              scratch->huge_pages_requested == huge_pages)) {
+            if (scratch->pos != 0) {
+                assertm(false, "Cannot resize a scratch arena while it's in use.");
+                return false;
+            }
+            arena_destroy(scratch);
+            *scratch = arena_create_huge(MAX(len, (usize)SCRATCH_ARENA_SIZE), false, huge_pages);
+            if (!scratch->data) {
+                return false;
+            }
+        }
+        granted = MIN(granted, scratch->huge_pages);
+    }
+    if (huge_pages_granted) {
+        *huge_pages_granted = granted;
+    }
+    return true;
+}
+
+// Like arena_prefault(), for the first `len` bytes of each of the calling thread's scratch arenas
+// (see scratch_reserve()).
+bool scratch_prefault(usize len, bool lock)
+{
+    bool success = true;
+    for (usize j = 0; j < MAX_SCRATCH_ARENAS; ++j) {
+        success = arena_prefault(&scratch_arenas[j], len, lock) && success;
+    }
+    return success;
+}
+
+// Like arena_bind_numa_node(), for the first `len` bytes of each of the calling thread's scratch
+// arenas (see scratch_reserve()).
+bool scratch_bind_numa_node(usize len, u32 node)
+{
+    bool success = true;
+    for (usize j = 0; j < MAX_SCRATCH_ARENAS; ++j) {
+        success = arena_bind_numa_node(&scratch_arenas[j], len, node) && success;
+    }
+    return success;
+}
+
+// Undo the locking done by scratch_prefault().
+void scratch_unlock(usize len)
+{
+    for (usize j = 0; j < MAX_SCRATCH_ARENAS; ++j) {
+        arena_unlock(&scratch_arenas[j], len);
+    }
+}
+
+// Release all of the calling thread's scratch arenas. They will be re-created if needed.
+void scratch_destroy_all()
+{
+    for (usize j = 0; j < MAX_SCRATCH_ARENAS; ++j) {
+        assertm(scratch_arenas[j].pos == 0, "Destroying a scratch arena that's in use.");
+        arena_destroy(&scratch_arenas[j]);
+    }
+}
 #define scratch_release(tmp) arena_tmp_end(tmp)
 
 // Push uninitialized space onto the arena.
@@ -637,9 +1228,9 @@ ArenaTmp scratch_get(Arena** conflicts, usize conflict_count)
 //
 byte* arena_push(Arena* a, usize len)
 {
-    if (a->pos + len > a->len) {
+    if (!arena_ensure(a, len)) {
         // Not enough space.
-        assertm(false, "No space remaining in Arena. Growing unimplemented.");
+        assertm(false, "No space remaining in Arena.");
         return 0;
     }
     byte* dst = a->data + a->pos;
@@ -666,9 +1257,9 @@ byte* arena_push_obj(Arena* a, byte* obj, usize len)
 //
 byte* arena_push_zero(Arena* a, usize len)
 {
-    if (a->pos + len > a->len) {
+    if (!arena_ensure(a, len)) {
         // Not enough space.
-        assertm(false, "No space remaining in Arena. Growing unimplemented.");
+        assertm(false, "No space remaining in Arena.");
         return 0;
     }
     byte* dst = a->data + a->pos;
@@ -677,6 +1268,21 @@ byte* arena_push_zero(Arena* a, usize len)
     return dst;
 }
 
+// Advance the Arena's position to a multiple of `alignment` (a power of two, at most the page
+// size), so that the next push is aligned to it. (The Arena's memory itself is page-aligned.)
+//
+// Return: true on success; false if there's not enough space.
+//
+bool arena_align(Arena* a, usize alignment)
+{
+    usize padding = (alignment - a->pos % alignment) % alignment;
+    if (!arena_ensure(a, padding)) {
+        return false;
+    }
+    a->pos += padding;
+    return true;
+}
+
 // Helpers (syntax sugar).
 #define arena_push_array(a, type, count) (type*)arena_push((a), sizeof(type)*(count))
 #define arena_push_array_zero(a, type, count) (type*)arena_push_zero((a), sizeof(type)*(count))
@@ -735,6 +1341,15 @@ T* darray_##TN##_push(Arena* a, darray_##TN* darr)                      \
     if (darr->len == darr->cap) {                                       \
         /* Out of space: must grow. */                                  \
         usize new_cap = MAX(1, 2 * darr->cap);                          \
+        usize extra = (new_cap - darr->cap) * sizeof(T);                \
+        if ((byte*)(darr->data + darr->cap) == a->data + a->pos &&      \
+            arena_ensure(a, extra)) {                                   \
+            /* At the top of the arena: grow in place. */               \
+            arena_push_zero(a, extra);                                  \
+            darr->cap = new_cap;                                        \
+            ++darr->len;                                                \
+            return darr->data + darr->len - 1;                          \
+        }                                                               \
         darray_##TN darrnew = darray_##TN##_new(a, new_cap);            \
         memcpy(darrnew.data, darr->data, darr->len * sizeof(T));        \
         darrnew.len = darr->len;                                        \
@@ -2,6 +2,14 @@
 #include <process.h>  // _beginthreadex, _endthreadex
 #else
 #include <pthread.h>  // pthread_create(), etc.
+#include <sched.h>    // cpu_set_t
+#include <signal.h>   // kill()
+#include <sys/prctl.h>  // prctl()
+#include <sys/resource.h>  // getrusage()
+#include <sys/syscall.h>   // SYS_getcpu
+#include <sys/types.h>  // pid_t
+#include <sys/wait.h>   // waitpid()
+#include <unistd.h>     // fork(), _exit()
 #endif
 
 #ifdef _WIN32
@@ -11,6 +19,7 @@
 #define THREAD_MUTEX HANDLE
 #define THREAD_ENTRYPOINT unsigned __stdcall
 #else
+#define PROCESS pid_t
 #define THREAD pthread_t
 // Struct to simulate Win32 event behavior.
 typedef struct {
@@ -23,6 +32,73 @@ typedef struct {
 #define THREAD_ENTRYPOINT void*
 #endif
 
+// Lock-free atomics, for sharing small values between threads without blocking either of them.
+// Loads have acquire semantics and stores have release semantics. On x86-64 these compile down to
+// ordinary loads and stores (plus a compiler barrier), so they're cheap enough to use in hot loops.
+
+u32 atomic_load_u32(u32 volatile* p)
+{
+    #ifdef _MSC_VER
+    u32 value = *p;
+    _ReadWriteBarrier();
+    return value;
+    #else
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    #endif
+}
+
+void atomic_store_u32(u32 volatile* p, u32 value)
+{
+    #ifdef _MSC_VER
+    _ReadWriteBarrier();
+    *p = value;
+    #else
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+    #endif
+}
+
+u64 atomic_load_u64(u64 volatile* p)
+{
+    #ifdef _MSC_VER
+    u64 value = *p;  // Aligned 64-bit accesses are atomic on x86-64.
+    _ReadWriteBarrier();
+    return value;
+    #else
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    #endif
+}
+
+void atomic_store_u64(u64 volatile* p, u64 value)
+{
+    #ifdef _MSC_VER
+    _ReadWriteBarrier();
+    *p = value;
+    #else
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+    #endif
+}
+
+// Memory fences, for seqlocks: a writer issues a release fence after marking the sequence number
+// odd (before writing data); a reader issues an acquire fence after reading data (before
+// re-checking the sequence number).
+void atomic_fence_release()
+{
+    #ifdef _MSC_VER
+    _ReadWriteBarrier();  // x86-64 doesn't reorder stores with other stores.
+    #else
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    #endif
+}
+
+void atomic_fence_acquire()
+{
+    #ifdef _MSC_VER
+    _ReadWriteBarrier();  // x86-64 doesn't reorder loads with other loads.
+    #else
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    #endif
+}
+
 void mutex_initialize(THREAD_MUTEX mtx)
 {
     #ifdef _WIN32
@@ -118,6 +194,77 @@ void event_wait(THREAD_EVENT evt)
     while (!evt->flag) {
         pthread_cond_wait(&evt->cond, &evt->mtx);
     }
+    pthread_mutex_unlock(&evt->mtx);
+    #endif
+}
+
+// Restrict the calling thread to run only on the given logical processor.
+// Return: true on success; false on error.
+bool thread_set_affinity_self(u32 cpu_id)
+{
+    #ifdef _WIN32
+    if (cpu_id >= 8 * sizeof(DWORD_PTR)) {
+        return false;  // Processor groups are unsupported.
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu_id) != 0;
+    #else
+    if (cpu_id >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu_id, &cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+    #endif
+}
+
+// Find the NUMA node of the logical processor that the calling thread is running on (which may
+// change at any time, unless the thread is pinned).
+// Return: true on success; false on error.
+bool thread_get_numa_node(u32* node)
+{
+    #ifdef _WIN32
+    PROCESSOR_NUMBER processor;
+    USHORT node_number = 0;
+    GetCurrentProcessorNumberEx(&processor);
+    if (!GetNumaProcessorNodeEx(&processor, &node_number)) {
+        return false;
+    }
+    *node = node_number;
+    return true;
+    #else
+    unsigned cpu = 0;
+    unsigned node_number = 0;
+    if (syscall(SYS_getcpu, &cpu, &node_number, NULL) != 0) {
+        return false;
+    }
+    *node = node_number;
+    return true;
+    #endif
+}
+
+// Counts of the things that can disturb a thread's timing, since it started.
+typedef struct
+{
+    u64 context_switches;  // Voluntary and involuntary.
+    u64 page_faults;       // Minor and major.
+} ThreadUsage;
+
+// Get the calling thread's usage counts.
+// Return: true on success; false on error, or if unsupported (on Windows).
+bool thread_get_usage(ThreadUsage* usage)
+{
+    #ifdef _WIN32
+    (void)usage;
+    return false;
+    #else
+    struct rusage ru;
+    if (getrusage(RUSAGE_THREAD, &ru) != 0) {
+        return false;
+    }
+    usage->context_switches = (u64)ru.ru_nvcsw + (u64)ru.ru_nivcsw;
+    usage->page_faults = (u64)ru.ru_minflt + (u64)ru.ru_majflt;
+    return true;
     #endif
 }
 
@@ -130,3 +277,61 @@ bool thread_has_joined(THREAD t)
     return pthread_timedjoin_np(t, NULL, &timeout) == 0;
     #endif
 }
+
+#ifndef _WIN32
+
+// Fork the calling process. Only the calling thread is copied into the child, so the child should
+// stick to its own work and finish with process_exit(). If the caller is multithreaded, any lock
+// held by another thread at the time of the fork (the logger's, malloc()'s, stdio's) stays locked
+// forever in the child, so the child must not take it: no logging, no stdio, no malloc(), no GUI.
+// The child is killed automatically if the parent exits first.
+//
+// Return: in the parent, the child's handle (or -1 on error); in the child, 0.
+PROCESS process_fork()
+{
+    PROCESS parent = getpid();
+    PROCESS child = fork();
+    if (child == 0) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != parent) {
+            _exit(1);  // The parent exited before prctl() took effect.
+        }
+    }
+    return child;
+}
+
+// Terminate the calling (child) process immediately, without running atexit() handlers or flushing
+// stdio buffers inherited from the parent.
+void process_exit(i32 exit_code)
+{
+    _exit(exit_code);
+}
+
+// Kill the child process. It still has to be reaped with process_has_exited().
+void process_kill(PROCESS p)
+{
+    kill(p, SIGKILL);
+}
+
+// Check, without blocking, whether the child process has exited. If so, reap it and report how it
+// ended: `exit_code` is its exit status, or -1 if it was terminated by signal `signal_num` (which
+// is otherwise 0).
+bool process_has_exited(PROCESS p, i32* exit_code, i32* signal_num)
+{
+    i32 status = 0;
+    PROCESS rtn = waitpid(p, &status, WNOHANG);
+    if (rtn == 0) {
+        return false;
+    }
+    *exit_code = -1;
+    *signal_num = 0;
+    if (rtn == p && WIFEXITED(status)) {
+        *exit_code = WEXITSTATUS(status);
+    } else if (rtn == p && WIFSIGNALED(status)) {
+        *signal_num = WTERMSIG(status);
+    }
+    // Otherwise, waitpid() failed (the child is gone, or was never ours); treat it as exited.
+    return true;
+}
+
+#endif